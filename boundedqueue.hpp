@@ -0,0 +1,81 @@
+#ifndef BOUNDEDQUEUE_HPP
+#define BOUNDEDQUEUE_HPP
+
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace tb {
+
+/// @brief Queue between a producer and a consumer thread holding at most a
+/// fixed number of values: the producer blocks while it is full, so that a
+/// fast producer never runs ahead of the consumer by more than that. Once
+/// closed, pushes are refused and pops return what is left.
+template <class T>
+class BoundedQueue {
+  std::deque<T> values_{};
+  std::size_t capacity_;
+  bool closed_{false};
+  mutable std::mutex mutex_{};
+  std::condition_variable notFull_{};
+  std::condition_variable notEmpty_{};
+
+ public:
+  explicit BoundedQueue(std::size_t capacity) : capacity_{capacity} {
+    assert(capacity > 0);
+  }
+
+  /// @brief Waits for room for the value; false if the queue was closed.
+  bool push(T value) {
+    std::unique_lock lock{mutex_};
+    notFull_.wait(lock,
+                  [this] { return closed_ || values_.size() < capacity_; });
+    if (closed_) return false;
+    values_.push_back(std::move(value));
+    notEmpty_.notify_one();
+    return true;
+  }
+
+  /// @brief Waits for a value; nothing once the queue is closed and empty.
+  std::optional<T> pop() {
+    std::unique_lock lock{mutex_};
+    notEmpty_.wait(lock, [this] { return closed_ || !values_.empty(); });
+    return take();
+  }
+
+  /// @brief A value if one is ready, without waiting.
+  std::optional<T> tryPop() {
+    std::lock_guard lock{mutex_};
+    return take();
+  }
+
+  /// @brief True once the queue is closed and every value has been popped.
+  bool exhausted() const {
+    std::lock_guard lock{mutex_};
+    return closed_ && values_.empty();
+  }
+
+  void close() {
+    std::lock_guard lock{mutex_};
+    closed_ = true;
+    notFull_.notify_all();
+    notEmpty_.notify_all();
+  }
+
+ private:
+  std::optional<T> take() {
+    if (values_.empty()) return std::nullopt;
+    std::optional<T> value{std::move(values_.front())};
+    values_.pop_front();
+    notFull_.notify_one();
+    return value;
+  }
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,61 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "boundedqueue.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "doctest.h"
+
+TEST_CASE("Testing BoundedQueue") {
+  tb::BoundedQueue<int> queue{4};
+
+  SUBCASE("Values come out in order") {
+    CHECK(queue.push(1));
+    CHECK(queue.push(2));
+    CHECK(queue.tryPop() == 1);
+    CHECK(queue.pop() == 2);
+    CHECK(!queue.tryPop());
+    CHECK(!queue.exhausted());
+  }
+
+  SUBCASE("Closing") {
+    queue.push(1);
+    queue.close();
+    CHECK(!queue.push(2));
+    CHECK(!queue.exhausted());
+    CHECK(queue.pop() == 1);
+    CHECK(!queue.pop());
+    CHECK(queue.exhausted());
+  }
+
+  SUBCASE("The producer never runs ahead by more than the capacity") {
+    std::atomic<int> pushed{0};
+    std::thread producer{[&] {
+      for (int i = 0; i != 1000; ++i) {
+        queue.push(i);
+        ++pushed;
+      }
+      queue.close();
+    }};
+
+    std::vector<int> popped;
+    while (auto value = queue.pop()) {
+      CHECK(pushed - static_cast<int>(popped.size()) <= 5);
+      popped.push_back(*value);
+    }
+    producer.join();
+    REQUIRE(popped.size() == 1000);
+    for (std::size_t i = 0; i != popped.size(); ++i) {
+      CHECK(popped[i] == static_cast<int>(i));
+    }
+  }
+
+  SUBCASE("Closing wakes a blocked producer") {
+    for (int i = 0; i != 4; ++i) queue.push(i);
+    std::thread producer{[&] { CHECK(!queue.push(4)); }};
+    queue.close();
+    producer.join();
+  }
+}
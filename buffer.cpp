@@ -0,0 +1,89 @@
+#include "buffer.hpp"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <vector>
+
+namespace tb {
+
+ByteStore::ByteStore(const std::string& directory) : directory_{directory} {
+  std::string name = directory_ + "/tb_sample_XXXXXX";
+  std::vector<char> path(name.begin(), name.end());
+  path.push_back('\0');
+
+  fd_ = ::mkstemp(path.data());
+  if (fd_ == -1) {
+    throw std::runtime_error{"Impossible to create a file in " + directory_};
+  }
+  ::unlink(path.data());
+}
+
+ByteStore::~ByteStore() {
+  if (fd_ == -1) {
+    std::free(data_);
+    return;
+  }
+  if (data_ != nullptr) ::munmap(data_, bytes_);
+  ::close(fd_);
+}
+
+ByteStore::ByteStore(ByteStore&& other) noexcept
+    : data_{std::exchange(other.data_, nullptr)},
+      bytes_{std::exchange(other.bytes_, 0)},
+      fd_{std::exchange(other.fd_, -1)},
+      directory_{std::move(other.directory_)} {
+  other.directory_.clear();
+}
+
+ByteStore& ByteStore::operator=(ByteStore&& other) noexcept {
+  std::swap(data_, other.data_);
+  std::swap(bytes_, other.bytes_);
+  std::swap(fd_, other.fd_);
+  std::swap(directory_, other.directory_);
+  return *this;
+}
+
+ByteStore ByteStore::emptyLike() const {
+  return isMapped() ? ByteStore{directory_} : ByteStore{};
+}
+
+void ByteStore::resize(std::size_t bytes) {
+  if (bytes == bytes_) return;
+
+  if (fd_ == -1) {
+    auto data = static_cast<char*>(std::realloc(data_, bytes));
+    if (data == nullptr && bytes != 0) throw std::bad_alloc{};
+    data_ = data;
+    bytes_ = bytes;
+    return;
+  }
+
+  // the file grows (sparsely) first, then the mapping is extended in place
+  // or moved, without copying the pages
+  if (::ftruncate(fd_, static_cast<off_t>(bytes)) == -1) {
+    throw std::runtime_error{"Impossible to grow a file in " + directory_};
+  }
+  void* data = nullptr;
+  if (bytes == 0) {
+    ::munmap(data_, bytes_);
+  } else if (data_ == nullptr) {
+    data = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  } else {
+    data = ::mremap(data_, bytes_, bytes, MREMAP_MAYMOVE);
+  }
+  if (data == MAP_FAILED) {
+    throw std::runtime_error{"Impossible to map a file in " + directory_};
+  }
+  if (data != nullptr) {
+    // values are mostly streamed in order, both when added and when analysed
+    ::madvise(data, bytes, MADV_SEQUENTIAL);
+  }
+  data_ = static_cast<char*>(data);
+  bytes_ = bytes;
+}
+
+}  // namespace tb
@@ -0,0 +1,141 @@
+#ifndef BUFFER_HPP
+#define BUFFER_HPP
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace tb {
+
+/// @brief Raw storage of a ValueBuffer: either heap memory or a memory-mapped
+/// temporary file, which lets the buffer outgrow the RAM and be paged in and
+/// out by the kernel. The file is unlinked as soon as it is created, so it
+/// disappears with the buffer.
+class ByteStore {
+  char* data_{nullptr};
+  std::size_t bytes_{0};
+  int fd_{-1};
+  std::string directory_{};
+
+ public:
+  ByteStore() = default;
+
+  /// @brief A file-backed store, with its file created in the directory.
+  explicit ByteStore(const std::string& directory);
+
+  ~ByteStore();
+
+  ByteStore(ByteStore&& other) noexcept;
+  ByteStore& operator=(ByteStore&& other) noexcept;
+  ByteStore(const ByteStore&) = delete;
+  ByteStore& operator=(const ByteStore&) = delete;
+
+  /// @brief An empty store with the same backend.
+  ByteStore emptyLike() const;
+
+  /// @brief Changes the size of the storage, keeping its content.
+  void resize(std::size_t bytes);
+
+  char* data() const { return data_; }
+  std::size_t bytes() const { return bytes_; }
+  bool isMapped() const { return !directory_.empty(); }
+};
+
+/// @brief Contiguous, growable array of trivially copyable values, with the
+/// subset of the std::vector interface used by Sample. Heap buffers grow
+/// geometrically, file-backed ones in chunks of a fixed size.
+template <class T>
+class ValueBuffer {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  ByteStore store_{};
+  std::size_t size_{0};
+
+  static constexpr std::size_t mappedChunk =
+      (std::size_t{64} << 20) / sizeof(T);
+
+  void grow(std::size_t n) {
+    auto capacity = store_.isMapped()
+                        ? (n + mappedChunk - 1) / mappedChunk * mappedChunk
+                        : std::max(n, 2 * this->capacity());
+    store_.resize(capacity * sizeof(T));
+  }
+
+ public:
+  ValueBuffer() = default;
+
+  explicit ValueBuffer(ByteStore store) : store_{std::move(store)} {}
+
+  ValueBuffer(const ValueBuffer& other) : store_{other.store_.emptyLike()} {
+    append({other.data(), other.size()});
+  }
+
+  ValueBuffer& operator=(const ValueBuffer& other) {
+    if (this != &other) {
+      ValueBuffer copy{other};
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  ValueBuffer(ValueBuffer&& other) noexcept
+      : store_{std::move(other.store_)}, size_{std::exchange(other.size_, 0)} {}
+
+  ValueBuffer& operator=(ValueBuffer&& other) noexcept {
+    store_ = std::move(other.store_);
+    size_ = std::exchange(other.size_, 0);
+    return *this;
+  }
+
+  const T* data() const { return reinterpret_cast<const T*>(store_.data()); }
+  T* data() { return reinterpret_cast<T*>(store_.data()); }
+
+  std::size_t size() const { return size_; }
+  std::size_t capacity() const { return store_.bytes() / sizeof(T); }
+  bool empty() const { return size_ == 0; }
+  bool isMapped() const { return store_.isMapped(); }
+
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size_; }
+
+  const T& operator[](std::size_t i) const {
+    assert(i < size_);
+    return data()[i];
+  }
+  T& operator[](std::size_t i) {
+    assert(i < size_);
+    return data()[i];
+  }
+
+  const T& back() const { return (*this)[size_ - 1]; }
+
+  void reserve(std::size_t n) {
+    if (n > capacity()) grow(n);
+  }
+
+  void push_back(T x) {
+    if (size_ == capacity()) grow(size_ + 1);
+    data()[size_++] = x;
+  }
+
+  void append(std::span<const T> xs) {
+    reserve(size_ + xs.size());
+    if (!xs.empty()) std::memcpy(data() + size_, xs.data(), xs.size_bytes());
+    size_ += xs.size();
+  }
+
+  void clear() { size_ = 0; }
+
+  friend bool operator==(const ValueBuffer& a, const ValueBuffer& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+  }
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "query.hpp"
+#include "tbill.h"
+#include "triangularbilliards.hpp"
+
+struct tb_border {
+  std::unique_ptr<tb::Border> border;
+};
+
+struct tb_ensemble {
+  tb::MultipleResult result;
+};
+
+namespace {
+
+thread_local std::string lastError;
+
+/// @brief Runs the body, turning any exception into TB_ERROR, as exceptions
+/// must not cross the C interface.
+template <class F>
+int guarded(F&& body) {
+  try {
+    body();
+    return TB_OK;
+  } catch (const std::invalid_argument& e) {
+    lastError = e.what();
+    return TB_ERR_ARGUMENT;
+  } catch (const std::exception& e) {
+    lastError = e.what();
+  } catch (...) {
+    lastError = "Unknown error";
+  }
+  return TB_ERROR;
+}
+
+void require(bool condition, const char* what) {
+  if (!condition) throw std::invalid_argument(what);
+}
+
+/// @brief Size of the first version of tb_ensemble_config. Later versions
+/// only add fields after it, which a caller built against an older tbill.h
+/// does not pass and which then keep their default value.
+constexpr std::size_t ensembleConfigV1 =
+    offsetof(tb_ensemble_config, reservoir) + sizeof(uint64_t);
+
+/// @brief The configuration as given by a caller of any known version: the
+/// prefix of struct_size bytes, the rest defaulted.
+tb_ensemble_config readConfig(const tb_ensemble_config* config) {
+  auto const size = config->struct_size;
+  require(size >= ensembleConfigV1 && size <= sizeof(tb_ensemble_config),
+          "Unknown version of tb_ensemble_config");
+  tb_ensemble_config c{};
+  std::memcpy(&c, config, size);
+  return c;
+}
+
+tb_statistics toC(const tb::Statistics& s) {
+  return {s.mean, s.sigma, s.skewness, s.kurtosis};
+}
+
+}  // namespace
+
+extern "C" {
+
+int tb_api_version(void) { return TB_API_VERSION; }
+
+const char* tb_last_error(void) { return lastError.c_str(); }
+
+int tb_border_create(double r1, double r2, double l, tb_border** out) {
+  return guarded([&] {
+    require(out != nullptr, "Null output pointer");
+    require(r1 >= 0. && r2 >= 0. && l > 0., "Invalid border value(s)");
+    *out = new tb_border{tb::createBorder(r1, r2, l)};
+  });
+}
+
+void tb_border_destroy(tb_border* border) { delete border; }
+
+int tb_final_states(const tb_border* border, const double* initial,
+                    double* final, size_t count, unsigned threads) {
+  return guarded([&] {
+    require(border != nullptr, "Null border");
+    require(count == 0 || (initial != nullptr && final != nullptr),
+            "Null buffer");
+    // the buffers hold 2 * count doubles
+    require(count <= SIZE_MAX / 2, "Too many conditions");
+    if (threads == 0) {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    tb::ThreadPool pool{threads};
+    tb::computeFinalStates({initial, 2 * count}, {final, 2 * count},
+                           *border->border, pool);
+  });
+}
+
+int tb_ensemble_run(const tb_border* border, const tb_ensemble_config* config,
+                    tb_ensemble** out) {
+  return guarded([&] {
+    require(border != nullptr && config != nullptr && out != nullptr,
+            "Null argument");
+    auto const given = readConfig(config);
+    // checked here, as the core assumes them valid
+    require(given.n > 0, "Invalid number of particles");
+    require(given.y0_err >= 0. && given.theta0_err >= 0.,
+            "Invalid spread of the initial conditions");
+    tb::EnsembleConfig const c{given.n,          given.y0_mean,
+                               given.y0_err,     given.theta0_mean,
+                               given.theta0_err, given.seed,
+                               given.reservoir};
+    *out = new tb_ensemble{
+        tb::runMultipleSimulations(c, border->border.get())};
+  });
+}
+
+void tb_ensemble_destroy(tb_ensemble* ensemble) { delete ensemble; }
+
+int tb_ensemble_counts(const tb_ensemble* ensemble, int64_t* accepted,
+                       int64_t* rejected) {
+  return guarded([&] {
+    require(ensemble != nullptr, "Null ensemble");
+    if (accepted != nullptr) *accepted = ensemble->result.accepted;
+    if (rejected != nullptr) *rejected = ensemble->result.rejected;
+  });
+}
+
+size_t tb_ensemble_size(const tb_ensemble* ensemble) {
+  return ensemble == nullptr ? 0 : ensemble->result.finalY.values().size();
+}
+
+const double* tb_ensemble_final_y(const tb_ensemble* ensemble) {
+  return ensemble == nullptr ? nullptr
+                             : ensemble->result.finalY.values().data();
+}
+
+const double* tb_ensemble_final_theta(const tb_ensemble* ensemble) {
+  return ensemble == nullptr ? nullptr
+                             : ensemble->result.finalTheta.values().data();
+}
+
+int tb_ensemble_statistics(const tb_ensemble* ensemble,
+                           tb_statistics* final_y,
+                           tb_statistics* final_theta) {
+  return guarded([&] {
+    require(ensemble != nullptr, "Null ensemble");
+    if (final_y != nullptr) {
+      *final_y = toC(ensemble->result.finalY.statistics());
+    }
+    if (final_theta != nullptr) {
+      *final_theta = toC(ensemble->result.finalTheta.statistics());
+    }
+  });
+}
+
+}  // extern "C"
@@ -0,0 +1,115 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "doctest.h"
+#include "query.hpp"
+#include "tbill.h"
+
+TEST_CASE("Testing the C interface") {
+  CHECK(tb_api_version() == TB_API_VERSION);
+
+  tb_border* border = nullptr;
+  REQUIRE(tb_border_create(20., 15., 50., &border) == TB_OK);
+  REQUIRE(border != nullptr);
+  auto const reference = tb::createBorder(20., 15., 50.);
+
+  SUBCASE("Final states in caller buffers") {
+    std::mt19937_64 eng{4};
+    std::normal_distribution<double> y{0., 8.};
+    std::normal_distribution<double> theta{0., 0.5};
+    std::vector<double> initial;
+    for (int i = 0; i != 5000; ++i) {
+      initial.push_back(y(eng));
+      initial.push_back(theta(eng));
+    }
+
+    std::vector<double> final(initial.size());
+    REQUIRE(tb_final_states(border, initial.data(), final.data(),
+                            initial.size() / 2, 2) == TB_OK);
+    std::vector<double> expected(initial.size());
+    tb::ThreadPool pool{1};
+    tb::computeFinalStates(initial, expected, *reference, pool);
+    CHECK(std::equal(final.begin(), final.end(), expected.begin(),
+                     [](double a, double b) {
+                       return a == b || (std::isnan(a) && std::isnan(b));
+                     }));
+    CHECK(tb_final_states(border, nullptr, nullptr, 0, 0) == TB_OK);
+  }
+
+  SUBCASE("Running an ensemble") {
+    tb_ensemble_config const config{sizeof(tb_ensemble_config), 10000, 5.,
+                                    0.01, 0.785, 0.001, 42, 0};
+    tb_ensemble* ensemble = nullptr;
+    REQUIRE(tb_ensemble_run(border, &config, &ensemble) == TB_OK);
+
+    auto const expected = tb::runMultipleSimulations(
+        {10000, 5., 0.01, 0.785, 0.001, 42}, reference.get());
+    int64_t accepted = 0;
+    int64_t rejected = 0;
+    CHECK(tb_ensemble_counts(ensemble, &accepted, &rejected) == TB_OK);
+    CHECK(accepted == expected.accepted);
+    CHECK(rejected == expected.rejected);
+    REQUIRE(tb_ensemble_size(ensemble) == expected.finalY.values().size());
+    CHECK(std::equal(expected.finalY.values().begin(),
+                     expected.finalY.values().end(),
+                     tb_ensemble_final_y(ensemble)));
+    CHECK(tb_ensemble_final_theta(ensemble)[7] ==
+          expected.finalTheta.values()[7]);
+
+    tb_statistics y{};
+    tb_statistics theta{};
+    CHECK(tb_ensemble_statistics(ensemble, &y, &theta) == TB_OK);
+    CHECK(y.mean == expected.finalY.statistics().mean);
+    CHECK(theta.kurtosis == expected.finalTheta.statistics().kurtosis);
+    tb_ensemble_destroy(ensemble);
+  }
+
+  SUBCASE("Errors are returned, with a message") {
+    tb_border* invalid = nullptr;
+    CHECK(tb_border_create(-1., 15., 50., &invalid) == TB_ERR_ARGUMENT);
+    CHECK(invalid == nullptr);
+    CHECK(std::string{tb_last_error()} == "Invalid border value(s)");
+    CHECK(tb_border_create(10., 15., 0., &invalid) == TB_ERR_ARGUMENT);
+    CHECK(tb_border_create(10., NAN, 50., &invalid) == TB_ERR_ARGUMENT);
+    CHECK(invalid == nullptr);
+
+    tb_ensemble_config config{sizeof(tb_ensemble_config), 10, 30., 0.01, 0.,
+                              0.001, 1, 0};
+    tb_ensemble* ensemble = nullptr;
+    REQUIRE(tb_ensemble_run(border, &config, &ensemble) == TB_OK);
+    tb_statistics y{};
+    CHECK(tb_ensemble_statistics(ensemble, &y, nullptr) == TB_ERROR);
+    CHECK(std::string{tb_last_error()} == "Not enough points");
+    tb_ensemble_destroy(ensemble);
+
+    CHECK(tb_ensemble_run(nullptr, &config, &ensemble) == TB_ERR_ARGUMENT);
+
+    config.n = 0;
+    CHECK(tb_ensemble_run(border, &config, &ensemble) == TB_ERR_ARGUMENT);
+    CHECK(std::string{tb_last_error()} == "Invalid number of particles");
+    config.n = -5;
+    CHECK(tb_ensemble_run(border, &config, &ensemble) == TB_ERR_ARGUMENT);
+    config.n = 10;
+    config.theta0_err = -0.001;
+    CHECK(tb_ensemble_run(border, &config, &ensemble) == TB_ERR_ARGUMENT);
+    config.theta0_err = 0.001;
+
+    // smaller than the first version, or larger than the current one
+    config.struct_size = sizeof(tb_ensemble_config) - 8;
+    CHECK(tb_ensemble_run(border, &config, &ensemble) == TB_ERR_ARGUMENT);
+    CHECK(std::string{tb_last_error()} ==
+          "Unknown version of tb_ensemble_config");
+    config.struct_size = sizeof(tb_ensemble_config) + 8;
+    CHECK(tb_ensemble_run(border, &config, &ensemble) == TB_ERR_ARGUMENT);
+
+    std::vector<double> pair(2);
+    CHECK(tb_final_states(border, pair.data(), pair.data(), SIZE_MAX / 2 + 1,
+                          1) == TB_ERR_ARGUMENT);
+  }
+
+  tb_border_destroy(border);
+}
@@ -0,0 +1,81 @@
+#include "collisionstream.hpp"
+
+#include <cassert>
+
+namespace tb {
+
+CollisionStream::CollisionStream(Particle start, const Border* border)
+    : start_{start}, border_{border} {
+  launch();
+}
+
+void CollisionStream::launch() {
+  // invalid initial conditions throw here, before any thread starts
+  CollisionGenerator generator{start_, border_};
+  queue_ = std::make_unique<BoundedQueue<Particle>>(ahead);
+  error_ = nullptr;
+  producer_ = std::thread{[this, generator]() mutable {
+    try {
+      while (auto p = generator.next()) {
+        if (!queue_->push(*p)) return;
+      }
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+    queue_->close();
+  }};
+}
+
+void CollisionStream::halt() {
+  if (queue_) queue_->close();
+  if (producer_.joinable()) producer_.join();
+}
+
+CollisionStream::Status CollisionStream::next(Particle& p, bool wait) {
+  if (stored_ != nullptr) {
+    if (index_ == stored_->size()) return Status::Finished;
+    p = (*stored_)[index_++];
+    return Status::Ready;
+  }
+  auto value = wait ? queue_->pop() : queue_->tryPop();
+  if (value) {
+    p = *value;
+    return Status::Ready;
+  }
+  if (!queue_->exhausted()) return Status::Waiting;
+  // the thread is done with error_ once the queue is closed
+  if (error_) std::rethrow_exception(error_);
+  return Status::Finished;
+}
+
+void CollisionStream::restart() {
+  if (stored_ != nullptr) {
+    index_ = 0;
+    return;
+  }
+  halt();
+  launch();
+}
+
+CollisionTrail::CollisionTrail(double tolerance, std::size_t history)
+    : path_{tolerance}, history_{history} {
+  assert(history > 0);
+}
+
+void CollisionTrail::restart(const Particle& start) {
+  path_.clear();
+  path_.append(start.x, start.y);
+  latest_.clear();
+  dropped_ = 0;
+}
+
+void CollisionTrail::reach(const Particle& p) {
+  path_.append(p.x, p.y);
+  latest_.push_back(p);
+  if (latest_.size() > history_) {
+    latest_.pop_front();
+    ++dropped_;
+  }
+}
+
+}  // namespace tb
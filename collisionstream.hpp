@@ -0,0 +1,95 @@
+#ifndef COLLISIONSTREAM_HPP
+#define COLLISIONSTREAM_HPP
+
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "boundedqueue.hpp"
+#include "lod.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief Positions of the trajectory shown by the viewer: either replayed
+/// from a stored trajectory, or computed on a simulation thread and passed
+/// through a bounded queue as the animation consumes them, so that the
+/// animation starts at once and the memory stays bounded however many
+/// collisions there are.
+class CollisionStream {
+  const std::vector<Particle>* stored_{nullptr};
+  std::size_t index_{0};
+  Particle start_{};
+  const Border* border_{nullptr};
+  std::unique_ptr<BoundedQueue<Particle>> queue_{};
+  std::thread producer_{};
+  std::exception_ptr error_{};
+
+  void launch();
+  void halt();
+
+ public:
+  enum class Status { Ready, Waiting, Finished };
+
+  /// @brief Positions computed at most this many ahead of the consumer.
+  static constexpr std::size_t ahead = 1024;
+
+  explicit CollisionStream(const std::vector<Particle>& stored)
+      : stored_{&stored} {}
+
+  /// @brief Throws on invalid initial conditions, before any thread starts.
+  CollisionStream(Particle start, const Border* border);
+
+  ~CollisionStream() { halt(); }
+
+  CollisionStream(const CollisionStream&) = delete;
+  CollisionStream& operator=(const CollisionStream&) = delete;
+
+  /// @brief The next position, if it has been computed already; with wait,
+  /// waits for it instead. An error of the simulation thread is rethrown
+  /// once the positions before it have been consumed.
+  Status next(Particle& p, bool wait = false);
+
+  /// @brief Starts again from the first position.
+  void restart();
+};
+
+/// @brief What the viewer keeps of the positions reached so far: the path
+/// through them at every level of detail, and the latest history ones for
+/// the list of collisions. Both are bounded (see PolylineLod), so that the
+/// viewer runs in fixed memory however many collisions it animates.
+class CollisionTrail {
+  PolylineLod path_;
+  std::deque<Particle> latest_{};
+  std::size_t history_;
+  std::size_t dropped_{0};
+
+ public:
+  explicit CollisionTrail(double tolerance, std::size_t history = 1 << 16);
+
+  /// @brief Forgets every position, the path starting again from start,
+  /// which is not listed.
+  void restart(const Particle& start);
+
+  void reach(const Particle& p);
+
+  const PolylineLod& path() const { return path_; }
+
+  /// @brief Number of positions reached since the start.
+  std::size_t size() const { return dropped_ + latest_.size(); }
+
+  /// @brief Number of the oldest position still listed.
+  std::size_t first() const { return dropped_; }
+
+  /// @brief The i-th position reached, for first() <= i < size().
+  const Particle& operator[](std::size_t i) const {
+    return latest_[i - dropped_];
+  }
+};
+
+}  // namespace tb
+
+#endif
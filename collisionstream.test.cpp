@@ -0,0 +1,139 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "collisionstream.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "doctest.h"
+
+namespace {
+
+using Status = tb::CollisionStream::Status;
+
+/// @brief The positions left in the stream, waiting for each.
+std::vector<tb::Particle> drain(tb::CollisionStream& stream) {
+  std::vector<tb::Particle> positions;
+  tb::Particle p{};
+  while (stream.next(p, true) == Status::Ready) positions.push_back(p);
+  return positions;
+}
+
+bool same(const tb::Particle& a, const tb::Particle& b) {
+  return a.x == b.x && a.y == b.y && a.theta == b.theta;
+}
+
+bool same(const std::vector<tb::Particle>& a,
+          const std::vector<tb::Particle>& b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](auto const& p, auto const& q) { return same(p, q); });
+}
+
+}  // namespace
+
+TEST_CASE("Testing CollisionStream") {
+  // thousands of collisions, more than the stream computes ahead
+  tb::StraightBorder border{10., 9.9, 1e5};
+  tb::Particle start{0., 1., 1.};
+  auto copy = start;
+  auto const expected = tb::computeSingleTrajectory(copy, &border).positions();
+  REQUIRE(expected.size() > 2 * tb::CollisionStream::ahead);
+
+  SUBCASE("The positions are computed on a thread") {
+    tb::CollisionStream stream{start, &border};
+    CHECK(same(drain(stream), expected));
+    tb::Particle p{};
+    CHECK(stream.next(p) == Status::Finished);
+
+    stream.restart();
+    CHECK(same(drain(stream), expected));
+  }
+
+  SUBCASE("Without waiting, the stream is Waiting until a position is ready") {
+    tb::CollisionStream stream{start, &border};
+    std::vector<tb::Particle> positions;
+    tb::Particle p{};
+    for (auto status = stream.next(p); status != Status::Finished;
+         status = stream.next(p)) {
+      if (status == Status::Ready) positions.push_back(p);
+    }
+    CHECK(same(positions, expected));
+  }
+
+  SUBCASE("Restarting or stopping half way") {
+    tb::CollisionStream stream{start, &border};
+    tb::Particle p{};
+    // the thread is blocked on the full queue meanwhile
+    for (int i = 0; i != 10; ++i) stream.next(p, true);
+    CHECK(same(p, expected[9]));
+    stream.restart();
+    CHECK(same(drain(stream), expected));
+
+    stream.restart();
+    stream.next(p, true);
+    // the destructor stops the thread
+  }
+
+  SUBCASE("Replaying a stored trajectory") {
+    tb::CollisionStream stream{expected};
+    CHECK(same(drain(stream), expected));
+    stream.restart();
+    CHECK(same(drain(stream), expected));
+  }
+
+  SUBCASE("Errors") {
+    // invalid initial conditions throw before any thread starts
+    tb::StraightBorder parallel{5., 5., 10.};
+    CHECK_THROWS_AS((tb::CollisionStream{{0., 0., M_PI / 2}, &parallel}),
+                    std::runtime_error);
+
+    // an error of the thread comes after the positions computed before it
+    tb::StraightBorder converging{10., 1., 100.};
+    tb::CollisionStream stream{{0., 1., 0.5}, &converging};
+    tb::Particle p{};
+    CHECK(stream.next(p, true) == Status::Ready);
+    CHECK(same(p, {0., 1., 0.5}));
+    CHECK_THROWS_AS(drain(stream), std::runtime_error);
+  }
+}
+
+TEST_CASE("Testing CollisionTrail") {
+  tb::CollisionTrail trail{0.01, 100};
+  trail.restart({0., 0., 0.});
+  CHECK(trail.size() == 0);
+  CHECK(trail.path().size() == 1);
+
+  SUBCASE("Only the latest positions are listed") {
+    for (int i = 0; i != 150; ++i) trail.reach({i * 0.1, 0., 0.});
+    CHECK(trail.size() == 150);
+    CHECK(trail.first() == 50);
+    CHECK(trail[50].x == 5.);
+    CHECK(trail[149].x == doctest::Approx(14.9));
+    CHECK(trail.path().size() == 151);
+
+    trail.restart({1., 1., 0.});
+    CHECK(trail.size() == 0);
+    CHECK(trail.first() == 0);
+    CHECK(trail.path().level(0).front().x == 1.);
+  }
+
+  SUBCASE("The memory stays bounded however many positions are reached") {
+    // 10^6 positions scattered over the billiard, as in a chaotic trajectory
+    tb::Particle last{};
+    for (long i = 0; i != 1'000'000; ++i) {
+      last = {static_cast<double>(i * 7919 % 1000) * 0.01,
+              static_cast<double>(i * 104729 % 997) * 0.01 - 5., 0.};
+      trail.reach(last);
+    }
+    CHECK(trail.size() == 1'000'000);
+    CHECK(trail.size() - trail.first() == 100);
+    CHECK(same(trail[trail.size() - 1], last));
+    auto const& path = trail.path();
+    for (std::size_t k = 0; k != path.levels(); ++k) {
+      CHECK(path.level(k).size() <= path.capacity());
+      CHECK(path.level(k).back().x == last.x);
+    }
+  }
+}
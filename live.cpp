@@ -0,0 +1,128 @@
+#include "live.hpp"
+
+#include <algorithm>
+
+namespace tb {
+
+namespace {
+
+struct Cancelled {};
+
+/// @brief Histograms of the particles of one block, checking for the
+/// cancellation of the run at each of them.
+class BlockSink : public ParticleSink {
+  const std::atomic<bool>& cancelled_;
+
+ public:
+  Snapshot histograms;
+
+  BlockSink(const std::atomic<bool>& cancelled, const Snapshot& snapshot)
+      : cancelled_{cancelled}, histograms{snapshot} {}
+
+  void accept(double, double, double Yf, double Thetaf) override {
+    if (cancelled_.load(std::memory_order_relaxed)) throw Cancelled{};
+    recordParticle(histograms, Yf, Thetaf);
+  }
+};
+
+}  // namespace
+
+LiveEnsemble::LiveEnsemble(const EnsembleConfig& config, const Border* border,
+                           unsigned threads)
+    : config_{config},
+      border_{border},
+      result_{makeEnsembleResult(config, border)},
+      snapshot_{makeSnapshot(*border, config)},
+      window_{2 * std::uint64_t{std::max(threads, 1u)}},
+      running_{std::max(threads, 1u)} {
+  config_.sink = nullptr;
+  config_.checkpoint.clear();
+  published_.store(snapshot_);
+  // running_ changes as soon as the first thread is done
+  for (unsigned i = 0; i != std::max(threads, 1u); ++i) {
+    workers_.emplace_back([this] { work(); });
+  }
+}
+
+void LiveEnsemble::cancel() {
+  {
+    std::lock_guard lock{mutex_};
+    cancelled_ = true;
+  }
+  progress_.notify_all();
+}
+
+LiveEnsemble::~LiveEnsemble() {
+  cancel();
+  for (auto& worker : workers_) {
+    if (worker.joinable()) worker.join();
+  }
+}
+
+void LiveEnsemble::work() {
+  auto const blocks = ensembleBlocks(config_.N);
+  // the bins of the ranges of the run, without counts
+  auto const empty = makeSnapshot(*border_, config_);
+  try {
+    while (true) {
+      std::uint64_t block = 0;
+      {
+        std::unique_lock lock{mutex_};
+        progress_.wait(lock, [&] {
+          return cancelled_ || next_ >= blocks || next_ < merged_ + window_;
+        });
+        if (cancelled_ || next_ >= blocks) break;
+        block = next_++;
+      }
+
+      BlockSink sink{cancelled_, empty};
+      auto config = config_;
+      config.sink = &sink;
+      auto result = runEnsembleBlock(config, border_, block);
+
+      std::lock_guard lock{mutex_};
+      completed_.emplace(block,
+                         std::pair{std::move(result), sink.histograms});
+      for (auto it = completed_.find(merged_); it != completed_.end();
+           it = completed_.find(++merged_)) {
+        auto const& [merging, histograms] = it->second;
+        mergeEnsembleBlock(result_, merging);
+        for (std::size_t i = 0; i != snapshotBins; ++i) {
+          snapshot_.histogramY[i] += histograms.histogramY[i];
+          snapshot_.histogramTheta[i] += histograms.histogramTheta[i];
+        }
+        completed_.erase(it);
+      }
+      recordProgress(snapshot_, result_);
+      published_.store(snapshot_);
+      progress_.notify_all();
+    }
+  } catch (const Cancelled&) {
+    // the block is dropped
+  } catch (...) {
+    {
+      std::lock_guard lock{mutex_};
+      if (!error_) error_ = std::current_exception();
+      cancelled_ = true;
+    }
+    progress_.notify_all();
+  }
+
+  std::lock_guard lock{mutex_};
+  if (--running_ == 0) {
+    // blocks completed after a missing one are not part of the result
+    completed_.clear();
+    snapshot_.done = 1;
+    published_.store(snapshot_);
+  }
+}
+
+MultipleResult LiveEnsemble::result() {
+  for (auto& worker : workers_) {
+    if (worker.joinable()) worker.join();
+  }
+  if (error_) std::rethrow_exception(error_);
+  return std::move(result_);
+}
+
+}  // namespace tb
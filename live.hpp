@@ -0,0 +1,74 @@
+#ifndef LIVE_HPP
+#define LIVE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "publish.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief A run of the ensemble in the background, its blocks spread over
+/// threads, watched through snapshots that never make the run wait. The
+/// blocks are merged in order as they complete, so that the result is the
+/// same as that of runMultipleSimulations; a cancelled run keeps the blocks
+/// before the first one missing, i.e. the particles of a shorter run with the
+/// same seed. The sink and the checkpoint of the configuration are not used.
+class LiveEnsemble {
+  EnsembleConfig config_;
+  const Border* border_;
+  MultipleResult result_;
+  Snapshot snapshot_;
+  SnapshotCell published_{};
+  // blocks completed ahead of the next one to merge, at most window_ of them:
+  // no block is started that far ahead of a slow one
+  std::map<std::uint64_t, std::pair<MultipleResult, Snapshot>> completed_{};
+  std::uint64_t merged_{0};
+  std::uint64_t next_{0};
+  std::uint64_t window_;
+  std::atomic<bool> cancelled_{false};
+  unsigned running_;
+  std::exception_ptr error_{};
+  std::mutex mutex_{};
+  std::condition_variable progress_{};
+  std::vector<std::thread> workers_{};
+
+  void work();
+
+ public:
+  /// @brief Starts the run on the given number of threads (at least one).
+  LiveEnsemble(const EnsembleConfig& config, const Border* border,
+               unsigned threads);
+
+  /// @brief Cancels the run and waits for its threads.
+  ~LiveEnsemble();
+
+  LiveEnsemble(const LiveEnsemble&) = delete;
+  LiveEnsemble& operator=(const LiveEnsemble&) = delete;
+
+  /// @brief The state of the run after the latest block merged; done once
+  /// no thread is left running, because the run completed or was cancelled.
+  Snapshot snapshot() const { return published_.load(); }
+
+  /// @brief Stops the run as soon as possible, dropping the blocks being
+  /// generated.
+  void cancel();
+
+  bool cancelled() const { return cancelled_; }
+
+  /// @brief Waits for the threads and hands over the blocks merged, once.
+  /// An error of a block cancels the run and is rethrown here.
+  MultipleResult result();
+};
+
+}  // namespace tb
+
+#endif
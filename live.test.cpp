@@ -0,0 +1,84 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "live.hpp"
+
+#include <atomic>
+#include <numeric>
+#include <thread>
+
+#include "doctest.h"
+
+TEST_CASE("Testing LiveEnsemble") {
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{6 * tb::ensembleBlock + 100, 0., 5., 0.3, 0.2, 5};
+
+  SUBCASE("Same result as a run on a single thread") {
+    config.keepInitial = true;
+    config.occupancyWidth = 40;
+    config.occupancyHeight = 20;
+    auto const expected = tb::runMultipleSimulations(config, &border);
+
+    tb::LiveEnsemble live{config, &border, 3};
+    auto const result = live.result();
+    CHECK(result.accepted == expected.accepted);
+    CHECK(result.rejected == expected.rejected);
+    CHECK(result.finalY.values() == expected.finalY.values());
+    CHECK(result.initialTheta.values() == expected.initialTheta.values());
+    CHECK(result.finalTheta.moments().m4() ==
+          expected.finalTheta.moments().m4());
+    CHECK(result.occupancy.counts() == expected.occupancy.counts());
+
+    auto const last = live.snapshot();
+    CHECK(last.done);
+    CHECK(last.N == static_cast<std::uint64_t>(config.N));
+    CHECK(last.accepted == static_cast<std::uint64_t>(expected.accepted));
+    CHECK(last.finalY.mean == expected.finalY.moments().mean());
+    CHECK(std::accumulate(std::begin(last.histogramY),
+                          std::end(last.histogramY),
+                          std::uint64_t{0}) == last.accepted);
+    auto const stats = tb::statistics(last.finalTheta);
+    CHECK(stats.sigma == expected.finalTheta.statistics().sigma);
+  }
+
+  SUBCASE("Snapshots are consistent while the run goes on") {
+    tb::LiveEnsemble live{config, &border, 2};
+    int inconsistent = 0;
+    int reads = 0;
+    while (true) {
+      auto const s = live.snapshot();
+      auto const total = std::accumulate(std::begin(s.histogramTheta),
+                                         std::end(s.histogramTheta),
+                                         std::uint64_t{0});
+      if (total != s.accepted || s.finalTheta.count != s.accepted ||
+          (s.accepted + s.rejected) % tb::ensembleBlock != 0) {
+        // only the last block is shorter
+        if (s.accepted + s.rejected != s.N) ++inconsistent;
+      }
+      ++reads;
+      if (s.done) break;
+      std::this_thread::yield();
+    }
+    CHECK(inconsistent == 0);
+    CHECK(reads > 0);
+    CHECK(live.result().accepted > 0);
+  }
+
+  SUBCASE("A cancelled run keeps a prefix of the blocks") {
+    config.N = 40 * tb::ensembleBlock;
+    tb::LiveEnsemble live{config, &border, 2};
+    while (live.snapshot().accepted == 0) std::this_thread::yield();
+    live.cancel();
+    CHECK(live.cancelled());
+    auto const result = live.result();
+    auto const generated = result.accepted + result.rejected;
+    CHECK(generated % tb::ensembleBlock == 0);
+    CHECK(generated < config.N);
+    CHECK(live.snapshot().done);
+    CHECK(live.snapshot().accepted ==
+          static_cast<std::uint64_t>(result.accepted));
+
+    config.N = generated;
+    auto const shorter = tb::runMultipleSimulations(config, &border);
+    CHECK(result.finalY.values() == shorter.finalY.values());
+  }
+}
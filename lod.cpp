@@ -0,0 +1,56 @@
+#include "lod.hpp"
+
+#include <cassert>
+#include <cmath>
+
+namespace tb {
+
+PolylineLod::PolylineLod(double tolerance, std::size_t levels,
+                         std::size_t capacity)
+    : tolerance_{tolerance},
+      capacity_{capacity},
+      levels_(levels),
+      provisional_(levels, false),
+      dropped_(levels, 0) {
+  assert(tolerance >= 0. && levels > 0 && capacity >= 2);
+}
+
+void PolylineLod::append(double x, double y) {
+  ++count_;
+  for (std::size_t k = 0; k != levels_.size(); ++k) {
+    auto& points = levels_[k];
+    if (provisional_[k]) points.pop_back();
+    auto const keep =
+        points.empty() ||
+        std::hypot(x - points.back().x, y - points.back().y) >= tolerance(k);
+    points.push_back({x, y});
+    provisional_[k] = !keep;
+    if (points.size() > capacity_) {
+      auto const erased = points.size() - capacity_ / 2;
+      points.erase(points.begin(),
+                   points.begin() + static_cast<std::ptrdiff_t>(erased));
+      dropped_[k] += erased;
+    }
+  }
+}
+
+void PolylineLod::clear() {
+  for (auto& points : levels_) points.clear();
+  provisional_.assign(levels_.size(), false);
+  dropped_.assign(levels_.size(), 0);
+  count_ = 0;
+}
+
+double PolylineLod::tolerance(std::size_t level) const {
+  return std::ldexp(tolerance_, static_cast<int>(level));
+}
+
+std::size_t PolylineLod::select(double maxError,
+                                std::size_t maxPoints) const {
+  std::size_t k = 0;
+  while (k + 1 != levels_.size() && tolerance(k + 1) <= maxError) ++k;
+  while (k + 1 != levels_.size() && levels_[k].size() > maxPoints) ++k;
+  return k;
+}
+
+}  // namespace tb
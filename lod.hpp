@@ -0,0 +1,69 @@
+#ifndef LOD_HPP
+#define LOD_HPP
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace tb {
+
+struct LodPoint {
+  double x;
+  double y;
+};
+
+/// @brief Multi-resolution representation of a polyline built while its
+/// points arrive. Level k keeps a point only if it is at least
+/// tolerance * 2^k away from the previous kept one, so that runs of shorter
+/// segments are merged with an error below that distance; the latest point
+/// ends every level, so that each level reaches the end of the polyline.
+/// A view with a pixel of size s shows the coarsest level with a tolerance
+/// below s exactly as the full polyline, with far fewer points.
+/// Each level holds at most capacity points: once it has more, its oldest
+/// half is dropped, so that the memory stays bounded however long the
+/// polyline grows. The finest levels then keep only the latest part of it,
+/// the coarser ones reach further back.
+class PolylineLod {
+  double tolerance_;
+  std::size_t capacity_;
+  std::vector<std::vector<LodPoint>> levels_;
+  // whether the last point of each level is only the latest one, to be
+  // replaced by the next
+  std::vector<bool> provisional_;
+  // points dropped from the front of each level
+  std::vector<std::size_t> dropped_;
+  std::size_t count_{0};
+
+ public:
+  explicit PolylineLod(double tolerance, std::size_t levels = 16,
+                       std::size_t capacity = 1 << 16);
+
+  void append(double x, double y);
+
+  void clear();
+
+  /// @brief Number of points appended.
+  std::size_t size() const { return count_; }
+
+  std::size_t levels() const { return levels_.size(); }
+
+  std::size_t capacity() const { return capacity_; }
+
+  double tolerance(std::size_t level) const;
+
+  /// @brief The coarsest level with a tolerance not above maxError (the
+  /// finest if there is none), or a coarser one if that has more than
+  /// maxPoints points.
+  std::size_t select(double maxError, std::size_t maxPoints) const;
+
+  std::span<const LodPoint> level(std::size_t k) const { return levels_[k]; }
+
+  /// @brief Number of points dropped so far from the front of level k; it
+  /// changes, and the points of the level move, only every capacity / 2
+  /// points kept.
+  std::size_t dropped(std::size_t k) const { return dropped_[k]; }
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,87 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "lod.hpp"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "doctest.h"
+
+TEST_CASE("Testing PolylineLod") {
+  tb::PolylineLod lod{0.01, 8};
+
+  SUBCASE("Dense points are merged, the latest one ends every level") {
+    // a zig-zag of 10000 points between y = -1 and y = 1, 0.001 apart in x
+    std::vector<tb::LodPoint> points;
+    for (int i = 0; i != 10000; ++i) {
+      points.push_back({i * 0.001, (i % 2 == 0 ? -1. : 1.) * 1e-3 * (i % 7)});
+      lod.append(points.back().x, points.back().y);
+    }
+    CHECK(lod.size() == 10000);
+
+    for (std::size_t k = 0; k != lod.levels(); ++k) {
+      auto const level = lod.level(k);
+      CHECK(level.front().x == points.front().x);
+      CHECK(level.back().x == points.back().x);
+      if (k != 0) CHECK(level.size() <= lod.level(k - 1).size());
+
+      // every point is within the tolerance of the last kept one before it
+      std::size_t j = 0;
+      for (auto const& p : points) {
+        while (j + 1 < level.size() && level[j + 1].x <= p.x) ++j;
+        CHECK(std::hypot(p.x - level[j].x, p.y - level[j].y) <=
+              lod.tolerance(k) + 1e-12);
+      }
+    }
+    CHECK(lod.level(lod.levels() - 1).size() < 20);
+  }
+
+  SUBCASE("Selecting a level") {
+    for (int i = 0; i != 1000; ++i) lod.append(i * 0.01, 0.);
+    CHECK(lod.select(0., 1000) == 0);
+    CHECK(lod.select(0.04, 1000) == 2);
+    CHECK(lod.select(0.05, 1000) == 2);
+    CHECK(lod.select(100., 1000) == lod.levels() - 1);
+    // too many points for the finest levels
+    CHECK(lod.select(0., 200) == 3);
+  }
+
+  SUBCASE("Levels keep at most capacity points") {
+    tb::PolylineLod bounded{0.01, 4, 1 << 12};
+    // 10^7 points scattered over a square, mostly far apart as in a
+    // chaotic trajectory, so that every level keeps nearly all of them
+    tb::LodPoint last{};
+    for (long i = 0; i != 10'000'000; ++i) {
+      last = {static_cast<double>(i * 7919 % 1000) * 0.01,
+              static_cast<double>(i * 104729 % 997) * 0.01};
+      bounded.append(last.x, last.y);
+    }
+    CHECK(bounded.size() == 10'000'000);
+
+    for (std::size_t k = 0; k != bounded.levels(); ++k) {
+      auto const level = bounded.level(k);
+      CHECK(level.size() <= bounded.capacity());
+      CHECK(level.size() >= bounded.capacity() / 2);
+      CHECK(level.back().x == last.x);
+      CHECK(level.back().y == last.y);
+      CHECK(bounded.dropped(k) + level.size() <= bounded.size());
+      // the coarser levels reach further back
+      if (k != 0) CHECK(bounded.dropped(k) <= bounded.dropped(k - 1));
+    }
+    CHECK(bounded.dropped(0) > 9'000'000);
+
+    bounded.clear();
+    CHECK(bounded.dropped(0) == 0);
+  }
+
+  SUBCASE("Points far apart are all kept") {
+    lod.append(0., 0.);
+    lod.append(10., 0.);
+    lod.append(20., 10.);
+    CHECK(lod.level(lod.levels() - 1).size() == 3);
+    lod.clear();
+    CHECK(lod.size() == 0);
+    CHECK(lod.level(0).empty());
+  }
+}
@@ -1,19 +1,227 @@
+#include <pthread.h>
+
+#include <charconv>
+#include <csignal>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
 
+#include "publish.hpp"
+#include "query.hpp"
+#include "render.hpp"
+#include "results.hpp"
+#include "script.hpp"
+#include "server.hpp"
+#include "shard.hpp"
 #include "simulation.hpp"
 #include "statistics.hpp"
 #include "triangularbilliards.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
   try {
+    auto printStats = [](const tb::Statistics stats, const std::string& var) {
+      std::cout << "Final " << var << " :\n - Mean : " << stats.mean
+                << "\n - Sigma : " << stats.sigma
+                << "\n - Skewness : " << stats.skewness
+                << "\n - Kurtosis : " << stats.kurtosis << '\n';
+    };
+
+    // the options are matched first, so that a mistyped or incomplete one is
+    // not taken for a script
+    if (argc > 1 && std::string{argv[1]}.starts_with("--")) {
+      std::string const option = argv[1];
+      auto const args = argc - 2;
+      char const* usage = nullptr;
+      if (option == "--serve") {
+        if (args < 1 || (args - 1) % 3 != 0) usage = "SOCKET (R1 R2 L)...";
+      } else if (option == "--merge") {
+        if (args < 2) usage = "OUTPUT PARTIAL...";
+      } else if (option == "--render") {
+        if (args < 7 || (args - 2) % 5 != 0) {
+          usage = "PREFIX FRAMES R1 R2 L Y0 THETA0 (R1 R2 L Y0 THETA0)...";
+        }
+      } else {
+        std::cerr << "Unknown option " << option
+                  << ", expected --serve, --merge or --render\n";
+        return EXIT_FAILURE;
+      }
+      if (usage != nullptr) {
+        std::cerr << "Usage: " << argv[0] << ' ' << option << ' ' << usage
+                  << '\n';
+        return EXIT_FAILURE;
+      }
+    }
+
+    // daemon mode: final-state queries on a Unix socket until interrupted,
+    // with the geometries given preloaded
+    if (argc > 2 && std::string{argv[1]} == "--serve") {
+      // the signals are blocked in every thread, and only waited for here
+      sigset_t signals;
+      sigemptyset(&signals);
+      sigaddset(&signals, SIGINT);
+      sigaddset(&signals, SIGTERM);
+      pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+      auto const threads = std::max(std::thread::hardware_concurrency(), 1u);
+      tb::QueryServer server{argv[2], threads};
+      for (int a = 3; a + 2 < argc; a += 3) {
+        auto const id = server.addBorder(std::stod(argv[a]),
+                                         std::stod(argv[a + 1]),
+                                         std::stod(argv[a + 2]));
+        std::cout << "Border " << id << ": " << argv[a] << ' ' << argv[a + 1]
+                  << ' ' << argv[a + 2] << '\n';
+      }
+      std::cout << "Serving on " << argv[2] << std::endl;
+
+      int signal = 0;
+      sigwait(&signals, &signal);
+      server.stop();
+      return EXIT_SUCCESS;
+    }
+
+    // merge mode: the partial results of the shards of a run, combined into
+    // the results file of the whole run, or into the histograms of its final
+    // values when the shards only kept moments
+    if (argc > 3 && std::string{argv[1]} == "--merge") {
+      auto const run =
+          tb::mergeShards(std::vector<std::string>{argv + 3, argv + argc});
+      if (run.rawSamples) {
+        tb::writeResults(argv[2], *run.border, run.config, run.result);
+      } else {
+        std::ofstream os{argv[2]};
+        auto const& summary = run.summary;
+        os << "Yf\tcount\tThetaf\tcount\n";
+        for (std::size_t i = 0; i != tb::snapshotBins; ++i) {
+          // centre of the bin, in units of the range
+          auto const x =
+              (2. * static_cast<double>(i) + 1.) / tb::snapshotBins - 1.;
+          os << x * summary.yRange << '\t' << summary.histogramY[i] << '\t'
+             << x * summary.thetaRange << '\t' << summary.histogramTheta[i]
+             << '\n';
+        }
+        if (!os) {
+          throw std::runtime_error(std::string{"Impossible to write "} +
+                                   argv[2]);
+        }
+      }
+      std::cout << "Seed: " << run.config.seed
+                << "\nAccepted: " << run.result.accepted
+                << "\nRejected: " << run.result.rejected << '\n';
+      if (run.result.accepted >= 4) {
+        printStats(run.result.finalY.statistics(), "Y");
+        printStats(run.result.finalTheta.statistics(), "Theta");
+      }
+      return EXIT_SUCCESS;
+    }
+
+    // render mode: images of the trajectories of particles in several
+    // geometries, drawn without a window; FRAMES = 0 gives a single image
+    // of each whole trajectory, otherwise an animation of that many frames
+    if (argc > 8 && std::string{argv[1]} == "--render") {
+      std::string const prefix = argv[2];
+      auto const frames = static_cast<unsigned>(std::stoul(argv[3]));
+      auto const threads = std::max(std::thread::hardware_concurrency(), 1u);
+      tb::ThreadPool pool{threads};
+      auto const many = argc > 9;
+      for (int a = 4, i = 0; a + 4 < argc; a += 5, ++i) {
+        auto const border = tb::createBorder(
+            std::stod(argv[a]), std::stod(argv[a + 1]), std::stod(argv[a + 2]));
+        tb::Particle p{0., std::stod(argv[a + 3]), std::stod(argv[a + 4])};
+        auto const traj = tb::computeSingleTrajectory(p, border.get());
+        auto const name = many ? prefix + std::to_string(i) : prefix;
+        if (frames == 0) {
+          auto image = tb::renderTrajectory(traj.positions(), border.get(), {});
+          tb::saveImage(std::move(image), name + ".png", pool);
+        } else {
+          tb::renderFrames(traj.positions(), border.get(), name + "_", frames,
+                           {}, pool);
+        }
+      }
+      pool.wait();
+      return EXIT_SUCCESS;
+    }
+
+    // script mode: the jobs of all the scripts given run concurrently
+    if (argc > 1) {
+      std::vector<tb::Job> jobs;
+      for (int a = 1; a != argc; ++a) {
+        std::ifstream script{argv[a]};
+        if (!script) {
+          throw std::runtime_error(std::string{"Impossible to open "} +
+                                   argv[a]);
+        }
+        auto const prefix =
+            std::filesystem::path{argv[a]}.replace_extension().string();
+        auto parsed = tb::parseScript(script, prefix);
+        jobs.insert(jobs.end(), parsed.begin(), parsed.end());
+      }
+
+      auto const threads = std::max(std::thread::hardware_concurrency(), 1u);
+      bool failed = false;
+      for (auto const& summary : tb::runJobs(jobs, threads)) {
+        std::cout << summary.name << " - Seed: " << summary.seed << '\n';
+        if (!summary.error.empty()) {
+          std::cerr << summary.name << ": " << summary.error << '\n';
+          failed = true;
+          continue;
+        }
+        std::cout << "Accepted: " << summary.accepted
+                  << "\nRejected: " << summary.rejected << '\n';
+        printStats(summary.finalY, "Y");
+        printStats(summary.finalTheta, "Theta");
+      }
+      return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    auto printRun = [&printStats](const tb::MultipleResult& result,
+                                  std::uint64_t seed) {
+      std::cout << "Seed: " << seed << "\nAccepted: " << result.accepted
+                << "\nRejected: " << result.rejected << '\n';
+
+      if (result.accepted < 4) {
+        throw std::runtime_error(
+            "Not enough particles reach final conditions to run statistics");
+      }
+      const auto statsY = result.finalY.statistics();
+      const auto statsTheta = result.finalTheta.statistics();
+
+      printStats(statsY, "Y");
+      printStats(statsTheta, "Theta");
+    };
+
     std::cout << "Valid commands: \n"
               << "- add borders [b R1 R2 L]\n"
               << "- calculate final conditions [f Y0 Theta0]\n"
+              << "- calculate final conditions of a file of initial ones, "
+                 "binary for .bin [F INPUT OUTPUT]\n"
               << "- run simulation of the trajectory [v (Y0) (Theta0)]\n"
+              << "- view K trajectories of the generated data, kept with "
+                 "i 1 [V K]\n"
+              << "- view the occupancy of the generated data [D]\n"
               << "- generate data [g N Y0_mean Y0_err Theta0_mean Theta0_err]\n"
+              << "- generate data on all cores with a live dashboard, Esc to "
+                 "stop early [G N Y0_mean Y0_err Theta0_mean Theta0_err]\n"
+              << "- keep at most K generated values, 0 for all [r K]\n"
+              << "- fix the seed of the generated data [s SEED]\n"
+              << "- also keep initial conditions, 1 for yes [i 0/1]\n"
+              << "- stream generated data to a file, - for none [w FILE]\n"
+              << "- keep generated data in files, - for memory [m DIR]\n"
+              << "- publish snapshots of generation to shared memory, - for "
+                 "none [p /NAME]\n"
+              << "- checkpoint generation to a file and resume from it, "
+                 "with r K set, - for none [c FILE (SECONDS)]\n"
+              << "- generate only a shard of the data into a file, merged "
+                 "with --merge, with the values if raw, - for all [h INDEX "
+                 "COUNT FILE (raw)]\n"
+              << "- fill an occupancy grid of W x H cells when generating, 0 "
+                 "for none [d W H]\n"
               << "- erase all values [e]\n"
-              << "- print data [o]\n"
+              << "- print data [o], or as text [o csv/tsv/txt (P)]\n"
+              << "- print data as NumPy arrays [o npy/npz]\n"
+              << "- print the occupancy of the data as an image [o png]\n"
               << "- quit [q]\n";
     char cmd{};
 
@@ -28,18 +236,27 @@ int main() {
              p.y <= b->r1() && p.y >= -b->r1();
     };
 
-    auto printStats = [](const tb::Statistics stats, const std::string& var) {
-      std::cout << "Final " << var << " :\n - Mean : " << stats.mean
-                << "\n - Sigma : " << stats.sigma
-                << "\n - Skewness : " << stats.skewness
-                << "\n - Kurtosis : " << stats.kurtosis << '\n';
-    };
-
     int N;
     double Y0_mean;
     double Y0_err;
     double Theta0_mean;
     double Theta0_err;
+    std::size_t reservoir = 0;
+    std::uint64_t seed = std::random_device{}();
+    bool keepInitial = false;
+    std::string streamPath = "-";
+    std::string publishName = "-";
+    std::unique_ptr<tb::SnapshotPublisher> publisher;
+    std::string mapDirectory = "-";
+    std::string checkpointPath = "-";
+    double checkpointInterval = 60.;
+    unsigned occupancyWidth = 0;
+    unsigned occupancyHeight = 0;
+    std::string shardPath = "-";
+    tb::ShardSpec shard{0, 1};
+    std::size_t viewCount = 0;
+    tb::EnsembleConfig config{};
+    std::unique_ptr<tb::Border> runBorder;
     tb::MultipleResult resultMultiple;
 
     while (std::cin >> cmd) {
@@ -70,6 +287,19 @@ int main() {
                   << "\n- Final Y: " << finalPos.y
                   << "\n- Final Theta: " << finalPos.theta << '\n';
 
+      } else if (cmd == 'F') {
+        std::string input;
+        std::string output;
+        std::cin >> input >> output;
+        if (!bordersSet) {
+          throw std::runtime_error("Set borders before running command F");
+        }
+
+        auto const threads = std::max(std::thread::hardware_concurrency(), 1u);
+        auto const count = tb::runQueries(input, output, *border, threads);
+        std::cout << "Final conditions of " << count << " particles written to "
+                  << output << '\n';
+
       } else if (cmd == 'v') {
         if (!bordersSet) {
           throw std::runtime_error("Set borders before running command v");
@@ -78,8 +308,40 @@ int main() {
           std::cin >> pos.y >> pos.theta;
         }
 
-        auto const traj = tb::computeSingleTrajectory(pos, border.get());
-        tb::runSimulation(traj.positions(), border.get());
+        // the collisions are computed while the animation runs
+        tb::runSimulation(pos, border.get());
+
+      } else if (cmd == 'V' && std::cin >> viewCount) {
+        if (!runBorder || resultMultiple.initialY.values().empty()) {
+          throw std::runtime_error(
+              "Generate data keeping initial conditions before running "
+              "command V");
+        }
+
+        // the retained initial conditions are a uniform subset of the
+        // accepted ones, in the same slots for Y0 and Theta0
+        auto const& ys = resultMultiple.initialY.values();
+        auto const& thetas = resultMultiple.initialTheta.values();
+        viewCount = std::min(viewCount, ys.size());
+        std::vector<tb::Trajectory> trajectories;
+        trajectories.reserve(viewCount);
+        for (std::size_t i = 0; i != viewCount; ++i) {
+          tb::Particle p{0., ys[i], thetas[i]};
+          try {
+            trajectories.push_back(
+                tb::computeSingleTrajectory(p, runBorder.get()));
+          } catch (const std::exception&) {
+            // invalid initial conditions are rejected by the run as well
+          }
+        }
+        tb::runEnsembleSimulation(trajectories, runBorder.get());
+
+      } else if (cmd == 'D') {
+        if (!runBorder || resultMultiple.occupancy.empty()) {
+          throw std::runtime_error(
+              "Generate data with an occupancy grid before running command D");
+        }
+        tb::runOccupancyView(resultMultiple.occupancy, runBorder.get());
 
       } else if (cmd == 'g' && std::cin >> N && std::cin >> Y0_mean &&
                  std::cin >> Y0_err && std::cin >> Theta0_mean &&
@@ -91,35 +353,220 @@ int main() {
           throw std::runtime_error("Invalid initial conditions");
         }
 
-        resultMultiple = tb::runMultipleSimulations(
-            N, Y0_mean, Y0_err, Theta0_mean, Theta0_err, border.get());
-        std::cout << "Accepted: " << resultMultiple.accepted
-                  << "\nRejected: " << resultMultiple.rejected << '\n';
+        config = {N,          Y0_mean, Y0_err,    Theta0_mean,
+                  Theta0_err, seed,    reservoir, keepInitial};
+        if (mapDirectory != "-") config.mapDirectory = mapDirectory;
+        config.occupancyWidth = occupancyWidth;
+        config.occupancyHeight = occupancyHeight;
+        bool resuming = false;
+        if (checkpointPath != "-") {
+          config.checkpoint = checkpointPath;
+          config.checkpointInterval = checkpointInterval;
+          resuming = std::filesystem::exists(checkpointPath);
+        }
+        if (shardPath != "-" && (streamPath != "-" || resuming)) {
+          throw std::runtime_error(
+              "Shards are not streamed nor resumed from checkpoints");
+        }
+        runBorder =
+            tb::createBorder(border->r1(), border->r2(), border->xEnd());
+
+        std::vector<tb::ParticleSink*> sinks;
+        std::unique_ptr<tb::ChunkedWriter> writer;
+        if (streamPath != "-") {
+          writer = std::make_unique<tb::ChunkedWriter>(
+              streamPath, *border, config, std::size_t{1} << 16, resuming);
+          sinks.push_back(writer.get());
+        }
+        // the last snapshot stays readable until the next run
+        publisher.reset();
+        if (publishName != "-") {
+          publisher = std::make_unique<tb::SnapshotPublisher>(publishName,
+                                                              *border, config);
+          sinks.push_back(publisher.get());
+        }
+        tb::SinkTee tee{sinks};
+        if (!sinks.empty()) config.sink = &tee;
+
+        if (shardPath != "-") {
+          // the seed is kept, as the other shards of the run need it
+          resultMultiple =
+              tb::runShard(config, border.get(), shard, shardPath);
+          std::cout << "Shard " << shard.index << " of " << shard.count
+                    << " written to " << shardPath << "\nSeed: " << config.seed
+                    << "\nAccepted: " << resultMultiple.accepted
+                    << "\nRejected: " << resultMultiple.rejected << '\n';
+          config.sink = nullptr;
+          continue;
+        }
 
-        if (resultMultiple.accepted < 4) {
+        if (resuming) {
+          std::cout << "Resuming from " << checkpointPath << '\n';
+          if (publisher) {
+            std::cout << "Published histograms only count the particles "
+                         "after the checkpoint\n";
+          }
+        }
+        resultMultiple = tb::runMultipleSimulations(config, border.get());
+        config.sink = nullptr;
+        if (writer) {
+          writer->close();
+          std::cout << "Generated data written to " << streamPath << '\n';
+        }
+        // the next run continues with fresh random numbers
+        seed = std::random_device{}();
+        printRun(resultMultiple, config.seed);
+
+      } else if (cmd == 'G' && std::cin >> N && std::cin >> Y0_mean &&
+                 std::cin >> Y0_err && std::cin >> Theta0_mean &&
+                 std::cin >> Theta0_err) {
+        if (!bordersSet) {
+          throw std::runtime_error("Set borders before running command G");
+        }
+        if (!isValidInput(pos, border.get())) {
+          throw std::runtime_error("Invalid initial conditions");
+        }
+        if (streamPath != "-" || publishName != "-" || checkpointPath != "-" ||
+            shardPath != "-") {
           throw std::runtime_error(
-              "Not enough particles reach final conditions to run statistics");
+              "The dashboard does not stream, publish, checkpoint nor shard "
+              "its run");
+        }
+
+        config = {N,          Y0_mean, Y0_err,    Theta0_mean,
+                  Theta0_err, seed,    reservoir, keepInitial};
+        if (mapDirectory != "-") config.mapDirectory = mapDirectory;
+        config.occupancyWidth = occupancyWidth;
+        config.occupancyHeight = occupancyHeight;
+        runBorder =
+            tb::createBorder(border->r1(), border->r2(), border->xEnd());
+        resultMultiple = tb::runEnsembleDashboard(config, runBorder.get());
+        seed = std::random_device{}();
+
+        auto const generated =
+            resultMultiple.accepted + resultMultiple.rejected;
+        if (generated < N) {
+          std::cout << "Cancelled after " << generated << " particles\n";
         }
-        const auto statsY = resultMultiple.finalY.statistics();
-        const auto statsTheta = resultMultiple.finalTheta.statistics();
+        printRun(resultMultiple, config.seed);
+
+      } else if (cmd == 'r' && std::cin >> reservoir) {
+        std::cout << (reservoir == 0 ? "Keeping all generated values\n"
+                                     : "Keeping a random subset of generated "
+                                       "values\n");
 
-        printStats(statsY, "Y");
-        printStats(statsTheta, "Theta");
+      } else if (cmd == 's' && std::cin >> seed) {
+        std::cout << "Next data generated with seed " << seed << '\n';
+
+      } else if (cmd == 'i' && std::cin >> keepInitial) {
+        std::cout << (keepInitial ? "Keeping initial conditions\n"
+                                  : "Not keeping initial conditions\n");
+
+      } else if (cmd == 'w' && std::cin >> streamPath) {
+        std::cout << (streamPath == "-" ? "Not streaming generated data\n"
+                                        : "Streaming generated data\n");
+
+      } else if (cmd == 'p' && std::cin >> publishName) {
+        std::cout << (publishName == "-" ? "Not publishing snapshots\n"
+                                         : "Publishing snapshots\n");
+
+      } else if (cmd == 'm' && std::cin >> mapDirectory) {
+        std::cout << "Keeping generated data in "
+                  << (mapDirectory == "-" ? "memory\n" : "files\n");
+
+      } else if (cmd == 'c' && std::cin >> checkpointPath) {
+        // optional interval in seconds, on the same line
+        std::string line;
+        std::getline(std::cin, line);
+        std::istringstream{line} >> checkpointInterval;
+        std::cout << (checkpointPath == "-" ? "Not checkpointing generation\n"
+                                            : "Checkpointing generation\n");
+
+      } else if (cmd == 'h') {
+        // - or the index, count and file of the shard, then an optional raw
+        // to keep the values in the shard, on the same line; a mistyped one
+        // leaves the previous setting
+        std::string line;
+        std::getline(std::cin, line);
+        std::istringstream args{line};
+        std::string index;
+        std::string count;
+        std::string path;
+        std::string raw;
+        args >> index >> count >> path >> raw;
+        auto const parse = [](const std::string& text, int& value) {
+          auto const end = text.data() + text.size();
+          auto const [last, error] = std::from_chars(text.data(), end, value);
+          return error == std::errc{} && last == end;
+        };
+        tb::ShardSpec spec{0, 1, raw == "raw"};
+        if (index == "-") {
+          shardPath = "-";
+          std::cout << "Generating all the data\n";
+        } else if (parse(index, spec.index) && parse(count, spec.count) &&
+                   spec.count > 0 && spec.index >= 0 &&
+                   spec.index < spec.count && !path.empty()) {
+          shard = spec;
+          shardPath = path;
+          std::cout << "Generating a shard of the data\n";
+        } else {
+          std::cout << "Invalid shard, expected h INDEX COUNT FILE (raw) with "
+                       "0 <= INDEX < COUNT, or h -\n";
+        }
+
+      } else if (cmd == 'd' && std::cin >> occupancyWidth >> occupancyHeight) {
+        if (occupancyWidth == 0 || occupancyHeight == 0) {
+          occupancyWidth = 0;
+          occupancyHeight = 0;
+        }
+        std::cout << (occupancyWidth == 0 ? "Not filling an occupancy grid\n"
+                                          : "Filling an occupancy grid\n");
 
       } else if (cmd == 'e') {
-        resultMultiple.finalY.remove_all();
-        resultMultiple.finalTheta.remove_all();
+        // everything about the run goes, so that o, V and D refuse to work
+        // on it instead of mixing it with the empty samples
+        resultMultiple = {};
+        runBorder.reset();
+        config = {};
 
       } else if (cmd == 'o') {
-        std::ofstream outfile{"results.txt"};
-
-        if (!outfile) {
-          throw std::runtime_error{"Impossible to open file!"};
+        if (!runBorder) {
+          throw std::runtime_error("Generate data before running command o");
         }
 
-        for (size_t i = 0; i != resultMultiple.finalY.size(); ++i) {
-          outfile << resultMultiple.finalY.values()[i] << " "
-                  << resultMultiple.finalTheta.values()[i] << '\n';
+        // optional text format and precision, on the same line
+        std::string line;
+        std::getline(std::cin, line);
+        std::istringstream args{line};
+        std::string kind;
+        int precision = -1;
+        args >> kind >> precision;
+
+        auto const threads = std::max(std::thread::hardware_concurrency(), 1u);
+        if (kind.empty()) {
+          tb::writeResults("results.tbr", *runBorder, config, resultMultiple);
+        } else if (kind == "csv" || kind == "tsv" || kind == "txt") {
+          auto format = kind == "csv"   ? tb::csvFormat
+                        : kind == "tsv" ? tb::tsvFormat
+                                        : tb::TextFormat{};
+          format.precision = precision;
+          tb::writeText("results." + kind, resultMultiple, format, threads);
+        } else if (kind == "npy") {
+          tb::writeNpyRecords("results.npy", resultMultiple);
+        } else if (kind == "npz") {
+          tb::writeNpz("results.npz", resultMultiple);
+        } else if (kind == "png") {
+          if (resultMultiple.occupancy.empty()) {
+            throw std::runtime_error("Generate data with an occupancy grid "
+                                     "before running command o png");
+          }
+          if (!tb::renderOccupancy(resultMultiple.occupancy, runBorder.get(),
+                                   {})
+                   .saveToFile("results.png")) {
+            throw std::runtime_error("Impossible to write results.png");
+          }
+        } else {
+          throw std::runtime_error("Unknown output format " + kind);
         }
 
         std::cout << "Output file written successfully. " << '\n';
@@ -128,7 +575,8 @@ int main() {
         return EXIT_SUCCESS;
 
       } else {
-        std::cout << "Command not found, insert new command:\n";
+        std::cout << "Command not found or invalid input, insert new "
+                     "command:\n";
         std::cin.clear();
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
       }
@@ -0,0 +1,129 @@
+#include "occupancy.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+OccupancyGrid::OccupancyGrid(unsigned width, unsigned height,
+                             const Border& border)
+    : width_{width},
+      height_{height},
+      xEnd_{border.xEnd()},
+      yRange_{std::max(border.r1(), border.r2())},
+      counts_(std::size_t{width} * height, 0) {
+  if (width == 0 || height == 0) {
+    throw std::invalid_argument("Invalid occupancy grid size");
+  }
+}
+
+std::uint64_t OccupancyGrid::max() const {
+  return counts_.empty() ? 0
+                         : *std::max_element(counts_.begin(), counts_.end());
+}
+
+void OccupancyGrid::addSegment(const Particle& a, const Particle& b) {
+  if (empty()) return;
+
+  // coordinates in cells, the grid spanning [0, width] x [0, height]
+  auto const w = static_cast<double>(width_);
+  auto const h = static_cast<double>(height_);
+  auto const ax = std::clamp(a.x / xEnd_ * w, 0., w);
+  auto const ay = std::clamp((a.y + yRange_) / (2. * yRange_) * h, 0., h);
+  auto const bx = std::clamp(b.x / xEnd_ * w, 0., w);
+  auto const by = std::clamp((b.y + yRange_) / (2. * yRange_) * h, 0., h);
+  auto const cell = [](double t, unsigned n) {
+    return std::min(static_cast<long>(t), static_cast<long>(n) - 1);
+  };
+  auto x = cell(ax, width_);
+  auto y = cell(ay, height_);
+  auto const xLast = cell(bx, width_);
+  auto const yLast = cell(by, height_);
+
+  // the segment crosses one cell boundary at a time, the nearest one along
+  // the segment being the next: tx and ty are the fractions of the segment
+  // at which the next vertical and horizontal boundaries are crossed
+  auto const dx = bx - ax;
+  auto const dy = by - ay;
+  auto const stepX = dx > 0. ? 1L : -1L;
+  auto const stepY = dy > 0. ? 1L : -1L;
+  auto const inf = HUGE_VAL;
+  auto tx = dx != 0. ? (static_cast<double>(x + (dx > 0.)) - ax) / dx : inf;
+  auto ty = dy != 0. ? (static_cast<double>(y + (dy > 0.)) - ay) / dy : inf;
+  auto const deltaX = dx != 0. ? 1. / std::abs(dx) : inf;
+  auto const deltaY = dy != 0. ? 1. / std::abs(dy) : inf;
+
+  // exactly one step per boundary, whatever the rounding of tx and ty
+  auto steps = std::labs(xLast - x) + std::labs(yLast - y);
+  ++counts_[static_cast<std::size_t>(y) * width_ +
+            static_cast<std::size_t>(x)];
+  for (; steps != 0; --steps) {
+    if (y == yLast || (x != xLast && tx < ty)) {
+      x += stepX;
+      tx += deltaX;
+    } else {
+      y += stepY;
+      ty += deltaY;
+    }
+    ++counts_[static_cast<std::size_t>(y) * width_ +
+              static_cast<std::size_t>(x)];
+  }
+}
+
+void OccupancyGrid::addTrajectory(Particle p, const Border* border) {
+  if (empty()) return;
+  CollisionGenerator generator{p, border};
+  auto previous = *generator.next();
+  while (auto next = generator.next()) {
+    addSegment(previous, *next);
+    previous = *next;
+  }
+}
+
+void OccupancyGrid::merge(const OccupancyGrid& other) {
+  if (other.empty()) return;
+  if (other.width_ != width_ || other.height_ != height_ ||
+      other.xEnd_ != xEnd_ || other.yRange_ != yRange_) {
+    throw std::invalid_argument(
+        "Cannot merge occupancy grids of different shape");
+  }
+  for (std::size_t i = 0; i != counts_.size(); ++i) {
+    counts_[i] += other.counts_[i];
+  }
+}
+
+void OccupancyGrid::save(std::ostream& os) const {
+  std::uint64_t const shape[2]{width_, height_};
+  double const range[2]{xEnd_, yRange_};
+  os.write(reinterpret_cast<const char*>(shape), sizeof(shape));
+  os.write(reinterpret_cast<const char*>(range), sizeof(range));
+  os.write(
+      reinterpret_cast<const char*>(counts_.data()),
+      static_cast<std::streamsize>(counts_.size() * sizeof(std::uint64_t)));
+}
+
+void OccupancyGrid::load(std::istream& is) {
+  std::uint64_t shape[2]{};
+  double range[2]{};
+  is.read(reinterpret_cast<char*>(shape), sizeof(shape));
+  is.read(reinterpret_cast<char*>(range), sizeof(range));
+  if (!is || shape[0] > (1 << 16) || shape[1] > (1 << 16)) {
+    throw std::runtime_error("Invalid occupancy grid");
+  }
+  width_ = static_cast<unsigned>(shape[0]);
+  height_ = static_cast<unsigned>(shape[1]);
+  xEnd_ = range[0];
+  yRange_ = range[1];
+  counts_.assign(std::size_t{width_} * height_, 0);
+  if (!is.read(reinterpret_cast<char*>(counts_.data()),
+               static_cast<std::streamsize>(counts_.size() *
+                                            sizeof(std::uint64_t)))) {
+    throw std::runtime_error("Truncated occupancy grid");
+  }
+}
+
+}  // namespace tb
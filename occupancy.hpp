@@ -0,0 +1,65 @@
+#ifndef OCCUPANCY_HPP
+#define OCCUPANCY_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace tb {
+
+struct Particle;
+struct Border;
+
+/// @brief Density of the paths of the particles inside a billiard: a grid of
+/// width x height cells over [0, L] x [-r, r], with r the larger of r1 and
+/// r2, counting how many trajectory segments cross each cell. The memory used
+/// does not depend on the number of trajectories, and grids filled
+/// separately, e.g. by different threads, are merged by adding their counts.
+class OccupancyGrid {
+  unsigned width_{0};
+  unsigned height_{0};
+  double xEnd_{0.};
+  double yRange_{0.};
+  std::vector<std::uint64_t> counts_{};
+
+ public:
+  /// @brief An empty grid, with no cells; it stays empty when merged.
+  OccupancyGrid() = default;
+
+  explicit OccupancyGrid(unsigned width, unsigned height, const Border& border);
+
+  unsigned width() const { return width_; }
+  unsigned height() const { return height_; }
+  bool empty() const { return counts_.empty(); }
+
+  /// @brief Counts of the cells by row, the first row being the bottom one
+  /// (y = -r).
+  const std::vector<std::uint64_t>& counts() const { return counts_; }
+  std::uint64_t at(unsigned column, unsigned row) const {
+    return counts_[std::size_t{row} * width_ + column];
+  }
+  std::uint64_t max() const;
+
+  /// @brief Adds one to every cell the segment crosses, by walking the grid
+  /// from cell to cell. Points outside the grid are moved to its edge.
+  /// Nothing is added to an empty grid.
+  void addSegment(const Particle& a, const Particle& b);
+
+  /// @brief Adds every segment of the trajectory of the particle, as given
+  /// by a CollisionGenerator, without storing it. An empty grid skips the
+  /// computation; invalid initial conditions throw.
+  void addTrajectory(Particle p, const Border* border);
+
+  /// @brief Adds the counts of another grid of the same shape; an empty grid
+  /// adds nothing.
+  void merge(const OccupancyGrid& other);
+
+  /// @brief Writes the shape and the counts of the grid in binary form.
+  void save(std::ostream& os) const;
+  void load(std::istream& is);
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,105 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <numeric>
+
+#include "doctest.h"
+#include "triangularbilliards.hpp"
+
+TEST_CASE("Testing OccupancyGrid segments") {
+  // cells of 1 x 1 over [0, 10] x [-5, 5]
+  tb::StraightBorder border{5., 5., 10.};
+  tb::OccupancyGrid grid{10, 10, border};
+  auto const total = [&grid] {
+    return std::accumulate(grid.counts().begin(), grid.counts().end(),
+                           std::uint64_t{0});
+  };
+
+  SUBCASE("Horizontal segment") {
+    grid.addSegment({0.5, 0.5, 0.}, {9.5, 0.5, 0.});
+    CHECK(total() == 10);
+    for (unsigned i = 0; i != 10; ++i) CHECK(grid.at(i, 5) == 1);
+  }
+
+  SUBCASE("Backwards segment") {
+    grid.addSegment({9.5, -4.5, 0.}, {2.5, -4.5, 0.});
+    CHECK(total() == 8);
+    CHECK(grid.at(2, 0) == 1);
+    CHECK(grid.at(1, 0) == 0);
+  }
+
+  SUBCASE("Diagonal segment") {
+    grid.addSegment({0.2, -4.9, 0.}, {9.9, 4.6, 0.});
+    // one cell per boundary crossed, plus the first one
+    CHECK(total() == 19);
+    CHECK(grid.at(0, 0) == 1);
+    CHECK(grid.at(9, 9) == 1);
+  }
+
+  SUBCASE("Points outside the grid") {
+    grid.addSegment({-5., 0.5, 0.}, {15., 0.5, 0.});
+    CHECK(total() == 10);
+  }
+
+  SUBCASE("Merging") {
+    grid.addSegment({0.5, 0.5, 0.}, {9.5, 0.5, 0.});
+    auto other = grid;
+    other.merge(grid);
+    other.merge(tb::OccupancyGrid{});
+    CHECK(other.at(3, 5) == 2);
+    CHECK(other.max() == 2);
+    CHECK_THROWS(other.merge(tb::OccupancyGrid{5, 10, border}));
+  }
+
+  SUBCASE("Empty grids") {
+    tb::OccupancyGrid empty;
+    empty.addSegment({0.5, 0.5, 0.}, {9.5, 0.5, 0.});
+    CHECK(empty.empty());
+    CHECK(empty.max() == 0);
+    CHECK_THROWS(tb::OccupancyGrid{0, 10, border});
+  }
+}
+
+TEST_CASE("Testing OccupancyGrid trajectories") {
+  tb::ClosedBorder border{20., 15., 50.};
+  tb::OccupancyGrid grid{100, 80, border};
+  tb::Particle p{0., 2., 0.6};
+  auto const trajectory = tb::computeSingleTrajectory(p, &border);
+
+  tb::OccupancyGrid expected{100, 80, border};
+  auto const& positions = trajectory.positions();
+  for (std::size_t i = 0; i + 1 < positions.size(); ++i) {
+    expected.addSegment(positions[i], positions[i + 1]);
+  }
+  grid.addTrajectory({0., 2., 0.6}, &border);
+  CHECK(grid.counts() == expected.counts());
+
+  std::stringstream ss;
+  grid.save(ss);
+  tb::OccupancyGrid loaded;
+  loaded.load(ss);
+  CHECK(loaded.counts() == grid.counts());
+  CHECK(loaded.width() == 100);
+  loaded.merge(grid);
+  CHECK(loaded.max() == 2 * grid.max());
+}
+
+TEST_CASE("Testing occupancy of Monte Carlo runs") {
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{2 * tb::ensembleBlock + 100, 5., 1., 0.785, 0.01,
+                            42, 0, true};
+  config.occupancyWidth = 64;
+  config.occupancyHeight = 32;
+  auto const result = tb::runMultipleSimulations(config, &border);
+
+  // the same grid as rasterizing every accepted trajectory in turn
+  tb::OccupancyGrid expected{64, 32, border};
+  auto const& ys = result.initialY.values();
+  auto const& thetas = result.initialTheta.values();
+  for (std::size_t i = 0; i != ys.size(); ++i) {
+    expected.addTrajectory({0., ys[i], thetas[i]}, &border);
+  }
+  CHECK(result.occupancy.counts() == expected.counts());
+
+  config.occupancyWidth = 0;
+  CHECK(tb::runMultipleSimulations(config, &border).occupancy.empty());
+}
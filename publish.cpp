@@ -0,0 +1,205 @@
+#include "publish.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+namespace tb {
+
+namespace {
+
+constexpr char snapshotMagic[8] = {'T', 'B', 'S', 'N', 'A', 'P', '\0', '\0'};
+constexpr std::uint64_t snapshotVersion = 2;
+
+static_assert(std::is_trivially_copyable_v<Snapshot> &&
+              sizeof(Snapshot) % sizeof(std::uint64_t) == 0);
+static_assert(std::atomic_ref<std::uint64_t>::is_always_lock_free);
+
+/// @brief Layout of the shared-memory segment. The snapshot is copied word by
+/// word with atomic accesses, so that a reader racing with the writer reads
+/// stale or mixed words, never torn ones, and detects it from the sequence
+/// number: odd while an update is in progress, and changed by it.
+struct Segment {
+  char magic[8];
+  std::uint64_t version;
+  std::uint64_t sequence;
+  std::uint64_t words[snapshotWords];
+};
+
+MomentSums sums(const Moments& m) {
+  return {m.count(), m.mean(), m.m2(), m.m3(), m.m4()};
+}
+
+void fill(std::uint64_t* histogram, double range, double x) {
+  auto const bin = std::floor((x + range) / (2. * range) * snapshotBins);
+  auto const last = static_cast<double>(snapshotBins - 1);
+  ++histogram[static_cast<std::size_t>(std::clamp(bin, 0., last))];
+}
+
+/// @brief The writer side of the sequence lock.
+void storeWords(std::uint64_t& sequenceWord, std::uint64_t* target,
+                const Snapshot& snapshot) {
+  std::uint64_t words[snapshotWords];
+  std::memcpy(words, &snapshot, sizeof(snapshot));
+
+  std::atomic_ref<std::uint64_t> sequence{sequenceWord};
+  auto const s = sequence.load(std::memory_order_relaxed);
+  sequence.store(s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (std::size_t i = 0; i != snapshotWords; ++i) {
+    std::atomic_ref<std::uint64_t>{target[i]}.store(words[i],
+                                                    std::memory_order_relaxed);
+  }
+  sequence.store(s + 2, std::memory_order_release);
+}
+
+/// @brief The reader side of the sequence lock, retrying until no update
+/// overlaps the copy.
+Snapshot loadWords(std::uint64_t& sequenceWord, std::uint64_t* source) {
+  std::atomic_ref<std::uint64_t> sequence{sequenceWord};
+  std::uint64_t words[snapshotWords];
+
+  while (true) {
+    auto const before = sequence.load(std::memory_order_acquire);
+    if (before % 2 == 0) {
+      for (std::size_t i = 0; i != snapshotWords; ++i) {
+        words[i] = std::atomic_ref<std::uint64_t>{source[i]}.load(
+            std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence.load(std::memory_order_relaxed) == before) break;
+    }
+    std::this_thread::yield();
+  }
+
+  Snapshot snapshot;
+  std::memcpy(&snapshot, words, sizeof(snapshot));
+  return snapshot;
+}
+
+void* mapSegment(int fd, int protection, const std::string& name) {
+  auto const segment =
+      ::mmap(nullptr, sizeof(Segment), protection, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (segment == MAP_FAILED) {
+    throw std::runtime_error{"Impossible to map " + name};
+  }
+  return segment;
+}
+
+}  // namespace
+
+Snapshot makeSnapshot(const Border& border, const EnsembleConfig& config) {
+  Snapshot snapshot{};
+  snapshot.N = static_cast<std::uint64_t>(config.N);
+  snapshot.yRange = std::max(border.r1(), border.r2());
+  snapshot.thetaRange = M_PI / 2;
+  return snapshot;
+}
+
+void recordParticle(Snapshot& snapshot, double Yf, double Thetaf) {
+  fill(snapshot.histogramY, snapshot.yRange, Yf);
+  fill(snapshot.histogramTheta, snapshot.thetaRange, Thetaf);
+}
+
+void recordProgress(Snapshot& snapshot, const MultipleResult& result) {
+  snapshot.accepted = static_cast<std::uint64_t>(result.accepted);
+  snapshot.rejected = static_cast<std::uint64_t>(result.rejected);
+  snapshot.finalY = sums(result.finalY.moments());
+  snapshot.finalTheta = sums(result.finalTheta.moments());
+}
+
+Statistics statistics(const MomentSums& sums) {
+  return Moments{sums.count, sums.mean, sums.m2, sums.m3, sums.m4}
+      .statistics();
+}
+
+void SnapshotCell::store(const Snapshot& snapshot) {
+  storeWords(sequence_, words_, snapshot);
+}
+
+Snapshot SnapshotCell::load() const { return loadWords(sequence_, words_); }
+
+SnapshotPublisher::SnapshotPublisher(const std::string& name,
+                                     const Border& border,
+                                     const EnsembleConfig& config)
+    : name_{name}, snapshot_{makeSnapshot(border, config)} {
+  auto const fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    throw std::runtime_error{"Impossible to create shared memory " + name};
+  }
+  if (::ftruncate(fd, sizeof(Segment)) == -1) {
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    throw std::runtime_error{"Impossible to allocate shared memory " + name};
+  }
+  try {
+    segment_ = mapSegment(fd, PROT_READ | PROT_WRITE, name);
+  } catch (...) {
+    ::shm_unlink(name.c_str());
+    throw;
+  }
+
+  // the segment is new and zeroed, so nothing can be read before the magic
+  // number, written last
+  auto& segment = *static_cast<Segment*>(segment_);
+  std::memcpy(segment.words, &snapshot_, sizeof(snapshot_));
+  segment.version = snapshotVersion;
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(segment.magic, snapshotMagic, sizeof(snapshotMagic));
+}
+
+SnapshotPublisher::~SnapshotPublisher() {
+  ::munmap(segment_, sizeof(Segment));
+  ::shm_unlink(name_.c_str());
+}
+
+void SnapshotPublisher::accept(double, double, double Yf, double Thetaf) {
+  recordParticle(snapshot_, Yf, Thetaf);
+}
+
+void SnapshotPublisher::resume(std::uint64_t accepted) {
+  // the values before the checkpoint are not saved in it, so they cannot be
+  // binned again
+  snapshot_.unbinned = accepted;
+}
+
+void SnapshotPublisher::progress(const MultipleResult& result) {
+  recordProgress(snapshot_, result);
+  snapshot_.done = snapshot_.accepted + snapshot_.rejected == snapshot_.N;
+  auto& segment = *static_cast<Segment*>(segment_);
+  storeWords(segment.sequence, segment.words, snapshot_);
+}
+
+SnapshotReader::SnapshotReader(const std::string& name) {
+  auto const fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd == -1) {
+    throw std::runtime_error{"Impossible to open shared memory " + name};
+  }
+  segment_ = mapSegment(fd, PROT_READ, name);
+
+  auto const& segment = *static_cast<const Segment*>(segment_);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (std::memcmp(segment.magic, snapshotMagic, sizeof(snapshotMagic)) != 0 ||
+      segment.version != snapshotVersion) {
+    ::munmap(segment_, sizeof(Segment));
+    throw std::runtime_error{name + " does not hold snapshots"};
+  }
+}
+
+SnapshotReader::~SnapshotReader() { ::munmap(segment_, sizeof(Segment)); }
+
+Snapshot SnapshotReader::read() const {
+  auto& segment = *static_cast<Segment*>(segment_);
+  return loadWords(segment.sequence, segment.words);
+}
+
+}  // namespace tb
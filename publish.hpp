@@ -0,0 +1,115 @@
+#ifndef PUBLISH_HPP
+#define PUBLISH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+inline constexpr std::size_t snapshotBins = 256;
+
+/// @brief Raw sums of a Moments accumulator, from which the statistics of
+/// the values can be computed (or further values merged).
+struct MomentSums {
+  std::uint64_t count;
+  double mean;
+  double m2;
+  double m3;
+  double m4;
+};
+
+/// @brief State of a running ensemble as published to shared memory: the
+/// counts, the moments of the final Y and Theta of all the accepted
+/// particles, and their histograms over [-yRange, yRange] and
+/// [-thetaRange, thetaRange], with values outside counted in the first and
+/// last bins. The histograms of a run resumed from a checkpoint are partial:
+/// the unbinned particles accepted before the checkpoint are missing from
+/// them, though not from the counts and the moments.
+struct Snapshot {
+  std::uint64_t N;
+  std::uint64_t accepted;
+  std::uint64_t rejected;
+  std::uint64_t done;
+  std::uint64_t unbinned;
+  double yRange;
+  double thetaRange;
+  MomentSums finalY;
+  MomentSums finalTheta;
+  std::uint64_t histogramY[snapshotBins];
+  std::uint64_t histogramTheta[snapshotBins];
+};
+
+inline constexpr std::size_t snapshotWords =
+    sizeof(Snapshot) / sizeof(std::uint64_t);
+
+/// @brief An empty snapshot of the run described by the configuration.
+Snapshot makeSnapshot(const Border& border, const EnsembleConfig& config);
+
+/// @brief Adds an accepted particle to the histograms of the snapshot.
+void recordParticle(Snapshot& snapshot, double Yf, double Thetaf);
+
+/// @brief Copies the counts and the moments of the result to the snapshot.
+void recordProgress(Snapshot& snapshot, const MultipleResult& result);
+
+/// @brief Statistics of the values summed, as Moments::statistics gives.
+Statistics statistics(const MomentSums& sums);
+
+/// @brief A snapshot shared by the threads of a process, guarded by the same
+/// sequence lock as the segment of a SnapshotPublisher: store() never waits
+/// for the threads calling load().
+class SnapshotCell {
+  mutable std::uint64_t sequence_{0};
+  mutable std::uint64_t words_[snapshotWords]{};
+
+ public:
+  /// @brief Replaces the snapshot; only one thread at a time may store.
+  void store(const Snapshot& snapshot);
+
+  /// @brief A consistent copy of the latest snapshot.
+  Snapshot load() const;
+};
+
+/// @brief Publishes snapshots of a run to a POSIX shared-memory segment
+/// after each block of particles. The segment is guarded by a sequence lock:
+/// the run never waits for the readers, which retry when they catch a
+/// snapshot being updated. The segment is removed with the publisher.
+class SnapshotPublisher : public ParticleSink {
+  std::string name_;
+  void* segment_{nullptr};
+  Snapshot snapshot_{};
+
+ public:
+  explicit SnapshotPublisher(const std::string& name, const Border& border,
+                             const EnsembleConfig& config);
+  ~SnapshotPublisher() override;
+
+  SnapshotPublisher(const SnapshotPublisher&) = delete;
+  SnapshotPublisher& operator=(const SnapshotPublisher&) = delete;
+
+  void accept(double Y0, double Theta0, double Yf, double Thetaf) override;
+  void resume(std::uint64_t accepted) override;
+  void progress(const MultipleResult& result) override;
+};
+
+/// @brief Read-only access to the segment of a SnapshotPublisher, possibly
+/// from another process.
+class SnapshotReader {
+  void* segment_{nullptr};
+
+ public:
+  explicit SnapshotReader(const std::string& name);
+  ~SnapshotReader();
+
+  SnapshotReader(const SnapshotReader&) = delete;
+  SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+  /// @brief A consistent copy of the latest snapshot.
+  Snapshot read() const;
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,108 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <atomic>
+#include <filesystem>
+#include <numeric>
+#include <thread>
+
+#include "doctest.h"
+#include "publish.hpp"
+
+TEST_CASE("Testing shared-memory snapshots") {
+  auto const name = "/tb_publish.test";
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{5 * tb::ensembleBlock, 0., 5., 0.3, 0.2, 9};
+
+  tb::SnapshotPublisher publisher{name, border, config};
+  tb::SnapshotReader reader{name};
+  auto const empty = reader.read();
+  CHECK(empty.N == static_cast<std::uint64_t>(config.N));
+  CHECK(empty.accepted == 0);
+  CHECK(!empty.done);
+
+  SUBCASE("Readers see consistent snapshots while the run goes on") {
+    std::atomic<bool> running{true};
+    std::atomic<int> inconsistent{0};
+    std::atomic<int> reads{0};
+    std::thread monitor{[&] {
+      while (running) {
+        auto const s = reader.read();
+        auto const total = std::accumulate(std::begin(s.histogramY),
+                                           std::end(s.histogramY),
+                                           std::uint64_t{0});
+        if (total != s.accepted || s.finalY.count != s.accepted ||
+            s.accepted + s.rejected >
+                static_cast<std::uint64_t>(config.N)) {
+          ++inconsistent;
+        }
+        ++reads;
+      }
+    }};
+
+    config.sink = &publisher;
+    auto const result = tb::runMultipleSimulations(config, &border);
+    running = false;
+    monitor.join();
+    CHECK(inconsistent == 0);
+    CHECK(reads > 0);
+
+    auto const last = reader.read();
+    CHECK(last.done);
+    CHECK(last.accepted == static_cast<std::uint64_t>(result.accepted));
+    CHECK(last.rejected == static_cast<std::uint64_t>(result.rejected));
+    CHECK(last.finalTheta.mean == result.finalTheta.moments().mean());
+    CHECK(last.finalTheta.m4 == result.finalTheta.moments().m4());
+    CHECK(std::accumulate(std::begin(last.histogramTheta),
+                          std::end(last.histogramTheta),
+                          std::uint64_t{0}) == last.accepted);
+  }
+
+  SUBCASE("Several sinks receive the same particles") {
+    struct Counter : tb::ParticleSink {
+      int accepted = 0;
+      int blocks = 0;
+      void accept(double, double, double, double) override { ++accepted; }
+      void progress(const tb::MultipleResult&) override { ++blocks; }
+    } counter;
+    tb::SinkTee tee{{&counter, &publisher}};
+    config.sink = &tee;
+    auto const result = tb::runMultipleSimulations(config, &border);
+    CHECK(counter.accepted == result.accepted);
+    CHECK(counter.blocks == 5);
+    CHECK(reader.read().accepted ==
+          static_cast<std::uint64_t>(result.accepted));
+  }
+
+  SUBCASE("The histograms of a resumed run are marked as partial") {
+    auto const path =
+        (std::filesystem::temp_directory_path() / "tb_publish.checkpoint")
+            .string();
+    std::filesystem::remove(path);
+    struct Interrupt : tb::ParticleSink {
+      int left = 3 * tb::ensembleBlock / 2;
+      void accept(double, double, double, double) override {
+        if (--left == 0) throw std::runtime_error("Interrupted");
+      }
+    } interrupt;
+    config.reservoir = 100;
+    config.checkpoint = path;
+    config.checkpointInterval = 0.;
+    config.sink = &interrupt;
+    CHECK_THROWS(tb::runMultipleSimulations(config, &border));
+
+    config.sink = &publisher;
+    auto const result = tb::runMultipleSimulations(config, &border);
+    auto const last = reader.read();
+    CHECK(last.accepted == static_cast<std::uint64_t>(result.accepted));
+    CHECK(last.unbinned > 0);
+    CHECK(last.unbinned < last.accepted);
+    CHECK(std::accumulate(std::begin(last.histogramY),
+                          std::end(last.histogramY), std::uint64_t{0}) +
+              last.unbinned ==
+          last.accepted);
+  }
+
+  SUBCASE("Only a publisher segment can be read") {
+    CHECK_THROWS(tb::SnapshotReader{"/tb_publish.missing"});
+  }
+}
@@ -0,0 +1,230 @@
+#include "query.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "textformat.hpp"
+
+namespace tb {
+
+namespace {
+
+/// @brief Number of conditions evaluated by each task.
+constexpr std::size_t batchSize = 4096;
+
+/// @brief A whole file mapped into memory: an existing file read-only, or a
+/// new file of the given size read-write.
+class Mapping {
+  void* data_{nullptr};
+  std::size_t size_{0};
+
+ public:
+  explicit Mapping(const std::string& path);
+  Mapping(const std::string& path, std::size_t size);
+  ~Mapping() {
+    if (data_ != nullptr) ::munmap(data_, size_);
+  }
+
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  void* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+ private:
+  void map(int fd, int protection, const std::string& path) {
+    if (size_ != 0) {
+      data_ = ::mmap(nullptr, size_, protection, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      throw std::runtime_error{"Impossible to map " + path};
+    }
+  }
+};
+
+Mapping::Mapping(const std::string& path) {
+  auto const fd = ::open(path.c_str(), O_RDONLY);
+  struct stat info {};
+  if (fd == -1 || ::fstat(fd, &info) == -1) {
+    if (fd != -1) ::close(fd);
+    throw std::runtime_error{"Impossible to open " + path};
+  }
+  size_ = static_cast<std::size_t>(info.st_size);
+  map(fd, PROT_READ, path);
+  if (data_ != nullptr) ::madvise(data_, size_, MADV_SEQUENTIAL);
+}
+
+Mapping::Mapping(const std::string& path, std::size_t size) : size_{size} {
+  auto const fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+  if (::ftruncate(fd, static_cast<off_t>(size)) == -1) {
+    ::close(fd);
+    throw std::runtime_error{"Impossible to allocate " + path};
+  }
+  map(fd, PROT_READ | PROT_WRITE, path);
+}
+
+/// @brief Appends the pairs on the lines of the text to the values.
+void parseConditions(std::string_view text, std::vector<double>& values,
+                     const std::string& path) {
+  auto const isBlank = [](char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+  };
+
+  auto p = text.data();
+  auto const end = text.data() + text.size();
+  while (p != end) {
+    auto const eol = std::find(p, end, '\n');
+    int count = 0;
+    while (true) {
+      while (p != eol && isBlank(*p)) ++p;
+      if (p == eol || *p == '#') break;
+      double x = 0.;
+      auto const r = std::from_chars(p, eol, x);
+      if (r.ec != std::errc{} || count == 2) {
+        throw std::runtime_error{"Invalid initial conditions in " + path};
+      }
+      values.push_back(x);
+      ++count;
+      p = r.ptr;
+    }
+    if (count == 1) {
+      throw std::runtime_error{"Invalid initial conditions in " + path};
+    }
+    p = eol == end ? end : eol + 1;
+  }
+}
+
+/// @brief Parses the text in pieces split at line ends, one task each.
+std::vector<double> parseConditions(std::string_view text, ThreadPool& pool,
+                                    const std::string& path) {
+  auto const pieces = pool.size() * 4;
+  std::vector<std::string_view> split;
+  auto const step = text.size() / pieces + 1;
+  for (std::size_t first = 0; first < text.size();) {
+    auto const eol = text.find('\n', first + step);
+    auto const last = eol == text.npos ? text.size() : eol + 1;
+    split.push_back(text.substr(first, last - first));
+    first = last;
+  }
+
+  std::vector<std::vector<double>> values(split.size());
+  for (std::size_t i = 0; i != split.size(); ++i) {
+    pool.submit([&, i] { parseConditions(split[i], values[i], path); });
+  }
+  pool.wait();
+
+  std::vector<double> all;
+  for (auto const& v : values) all.insert(all.end(), v.begin(), v.end());
+  return all;
+}
+
+void finalState(const double* initial, double* final, const Border& border) {
+  Particle const p{0., initial[0], initial[1]};
+  final[0] = final[1] = std::numeric_limits<double>::quiet_NaN();
+  if (std::fmod(std::abs(p.theta), 2 * M_PI) > M_PI / 2 ||
+      std::abs(p.y) > border.r1()) {
+    return;
+  }
+  try {
+    auto const r = computeFinalState(p, &border);
+    final[0] = r.y;
+    final[1] = r.theta;
+  } catch (const std::runtime_error&) {
+  }
+}
+
+void writeText(const std::string& path, std::span<const double> final,
+               ThreadPool& pool) {
+  std::ofstream out{path, std::ios::binary};
+  if (!out) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+
+  // Y and Theta alternate in the final states
+  std::span<const double> const columns[]{final,
+                                          final.subspan(final.empty() ? 0 : 1)};
+  writeRows(out, columns, final.size() / 2, {}, pool, 2);
+
+  if (!out) {
+    throw std::runtime_error{"Error while writing " + path};
+  }
+}
+
+}  // namespace
+
+QueryFormat queryFormat(const std::string& path) {
+  auto const dot = path.rfind('.');
+  return dot != std::string::npos && path.substr(dot) == ".bin"
+             ? QueryFormat::Binary
+             : QueryFormat::Text;
+}
+
+void computeFinalStates(std::span<const double> initial,
+                        std::span<double> final, const Border& border,
+                        ThreadPool& pool) {
+  assert(initial.size() % 2 == 0 && final.size() == initial.size());
+  auto const pairs = initial.size() / 2;
+  for (std::size_t first = 0; first < pairs; first += batchSize) {
+    pool.submit([=, &border] {
+      auto const last = std::min(pairs, first + batchSize);
+      for (auto i = first; i != last; ++i) {
+        finalState(&initial[2 * i], &final[2 * i], border);
+      }
+    });
+  }
+  pool.wait();
+}
+
+std::size_t runQueries(const std::string& input, const std::string& output,
+                       const Border& border, unsigned threads) {
+  ThreadPool pool{threads};
+  Mapping const source{input};
+  auto const size = source.size();
+
+  // binary conditions are read in place from the mapping
+  std::vector<double> parsed;
+  std::span<const double> initial;
+  if (queryFormat(input) == QueryFormat::Binary) {
+    if (size % (2 * sizeof(double)) != 0) {
+      throw std::runtime_error{input + " is not a file of initial conditions"};
+    }
+    initial = {static_cast<const double*>(source.data()),
+               size / sizeof(double)};
+  } else {
+    parsed = parseConditions({static_cast<const char*>(source.data()), size},
+                             pool, input);
+    initial = parsed;
+  }
+
+  if (queryFormat(output) == QueryFormat::Binary) {
+    // the final states are computed directly into the mapped output file
+    Mapping const target{output, initial.size() * sizeof(double)};
+    computeFinalStates(initial,
+                       {static_cast<double*>(target.data()), initial.size()},
+                       border, pool);
+  } else {
+    std::vector<double> final(initial.size());
+    computeFinalStates(initial, final, border, pool);
+    writeText(output, final, pool);
+  }
+
+  return initial.size() / 2;
+}
+
+}  // namespace tb
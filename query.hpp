@@ -0,0 +1,39 @@
+#ifndef QUERY_HPP
+#define QUERY_HPP
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+#include "threadpool.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief Format of a file of initial conditions, or of final states. Text
+/// files have one pair of numbers per line, separated by blanks or a comma,
+/// with # starting a comment line. Binary files are consecutive pairs of
+/// doubles in native byte order, with no header.
+enum class QueryFormat { Text, Binary };
+
+/// @brief Binary for the .bin extension, text otherwise.
+QueryFormat queryFormat(const std::string& path);
+
+/// @brief Computes the final (Y, Theta) of each initial (Y0, Theta0), both
+/// given as consecutive pairs, in batches run on the pool. The final states
+/// of conditions that cannot be simulated (Y0 outside the border, particle
+/// moving backwards) are NaN.
+void computeFinalStates(std::span<const double> initial,
+                        std::span<double> final, const Border& border,
+                        ThreadPool& pool);
+
+/// @brief Reads the initial conditions from the input file, memory-mapped,
+/// and writes their final states in the same order to the output file. The
+/// format of each file follows its extension. Returns the number of
+/// conditions.
+std::size_t runQueries(const std::string& input, const std::string& output,
+                       const Border& border, unsigned threads);
+
+}  // namespace tb
+
+#endif
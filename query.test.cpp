@@ -0,0 +1,122 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "doctest.h"
+#include "query.hpp"
+
+TEST_CASE("Testing computeFinalState() function") {
+  std::mt19937_64 eng{1};
+  std::uniform_real_distribution<double> y{-10., 10.};
+  std::uniform_real_distribution<double> theta{-1.5, 1.5};
+
+  for (double r2 : {10., 15., 2.}) {
+    auto const border = tb::createBorder(10., r2, 40.);
+    for (int i = 0; i != 1000; ++i) {
+      tb::Particle p{0., y(eng), theta(eng)};
+      tb::SingleResult final{};
+      try {
+        final = tb::computeFinalState(p, border.get());
+      } catch (const std::runtime_error&) {
+        CHECK_THROWS(tb::computeSingleTrajectory(p, border.get()));
+        continue;
+      }
+      auto const position =
+          tb::computeSingleTrajectory(p, border.get()).getFinalPosition();
+      CHECK(final.x == position.x);
+      CHECK(final.y == position.y);
+      CHECK(final.theta == position.theta);
+    }
+  }
+}
+
+TEST_CASE("Testing bulk final-state queries") {
+  auto const directory = std::filesystem::temp_directory_path();
+  auto const border = tb::createBorder(20., 15., 50.);
+
+  std::mt19937_64 eng{2};
+  std::normal_distribution<double> y{0., 8.};
+  std::normal_distribution<double> theta{0., 0.5};
+  std::vector<double> initial;
+  for (int i = 0; i != 20000; ++i) {
+    initial.push_back(y(eng));
+    initial.push_back(theta(eng));
+  }
+  // invalid conditions: outside the border, moving backwards
+  initial.insert(initial.end(), {25., 0., 0., 2.});
+
+  auto check = [&](const std::vector<double>& final) {
+    REQUIRE(final.size() == initial.size());
+    for (std::size_t i = 0; i + 4 != initial.size(); i += 2) {
+      if (std::abs(initial[i]) > 20. || std::abs(initial[i + 1]) > M_PI / 2) {
+        CHECK(std::isnan(final[i]));
+        continue;
+      }
+      tb::Particle p{0., initial[i], initial[i + 1]};
+      try {
+        auto const expected = tb::computeFinalState(p, border.get());
+        CHECK(final[i] == expected.y);
+        CHECK(final[i + 1] == expected.theta);
+      } catch (const std::runtime_error&) {
+        CHECK(std::isnan(final[i]));
+      }
+    }
+    CHECK(std::isnan(final[final.size() - 4]));
+    CHECK(std::isnan(final[final.size() - 1]));
+  };
+
+  SUBCASE("Computing in memory") {
+    tb::ThreadPool pool{3};
+    std::vector<double> final(initial.size());
+    tb::computeFinalStates(initial, final, *border, pool);
+    check(final);
+  }
+
+  SUBCASE("Binary files") {
+    auto const input = (directory / "tb_query.in.bin").string();
+    auto const output = (directory / "tb_query.out.bin").string();
+    std::ofstream{input, std::ios::binary}.write(
+        reinterpret_cast<const char*>(initial.data()),
+        static_cast<std::streamsize>(initial.size() * sizeof(double)));
+
+    CHECK(tb::runQueries(input, output, *border, 4) == initial.size() / 2);
+    std::vector<double> final(initial.size());
+    std::ifstream{output, std::ios::binary}.read(
+        reinterpret_cast<char*>(final.data()),
+        static_cast<std::streamsize>(final.size() * sizeof(double)));
+    check(final);
+  }
+
+  SUBCASE("Text files") {
+    auto const input = (directory / "tb_query.in.txt").string();
+    auto const output = (directory / "tb_query.out.txt").string();
+    {
+      std::ofstream out{input};
+      out << "# Y0 Theta0\n";
+      out.precision(17);
+      for (std::size_t i = 0; i != initial.size(); i += 2) {
+        out << initial[i] << (i % 4 == 0 ? ", " : "\t") << initial[i + 1]
+            << (i % 6 == 0 ? "\r\n" : "\n");
+        if (i == 100) out << '\n';
+      }
+    }
+
+    CHECK(tb::runQueries(input, output, *border, 4) == initial.size() / 2);
+    std::vector<double> final;
+    std::ifstream in{output};
+    std::string token;
+    while (in >> token) final.push_back(std::stod(token));
+    check(final);
+  }
+
+  SUBCASE("An odd number of values is rejected") {
+    auto const input = (directory / "tb_query.in.txt").string();
+    std::ofstream{input} << "1 0.1\n2\n";
+    CHECK_THROWS(tb::runQueries(input, input + ".out", *border, 2));
+  }
+}
@@ -0,0 +1,198 @@
+#include "render.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+#include "simulation.hpp"
+
+namespace tb {
+
+namespace {
+
+/// @brief RGBA pixels drawn in software, with alpha blending.
+class Canvas {
+  RenderSize size_;
+  std::vector<sf::Uint8> pixels_;
+
+ public:
+  Canvas(RenderSize size, sf::Color background)
+      : size_{size}, pixels_(std::size_t{size.width} * size.height * 4) {
+    for (std::size_t i = 0; i < pixels_.size(); i += 4) {
+      pixels_[i] = background.r;
+      pixels_[i + 1] = background.g;
+      pixels_[i + 2] = background.b;
+      pixels_[i + 3] = 255;
+    }
+  }
+
+  void blend(long x, long y, sf::Color c) {
+    if (x < 0 || y < 0 || x >= static_cast<long>(size_.width) ||
+        y >= static_cast<long>(size_.height)) {
+      return;
+    }
+    auto const i = (static_cast<std::size_t>(y) * size_.width +
+                    static_cast<std::size_t>(x)) *
+                   4;
+    auto const a = c.a / 255.f;
+    for (auto [k, v] : {std::pair{0, c.r}, {1, c.g}, {2, c.b}}) {
+      auto& p = pixels_[i + static_cast<std::size_t>(k)];
+      p = static_cast<sf::Uint8>(std::lround(p + (v - p) * a));
+    }
+  }
+
+  /// @brief One pixel per step along the longer axis.
+  void line(sf::Vector2f a, sf::Vector2f b, sf::Color c) {
+    auto const steps = std::max(
+        1.f, std::ceil(std::max(std::abs(b.x - a.x), std::abs(b.y - a.y))));
+    for (float i = 0.f; i <= steps; ++i) {
+      auto const t = i / steps;
+      blend(std::lround(a.x + (b.x - a.x) * t),
+            std::lround(a.y + (b.y - a.y) * t), c);
+    }
+  }
+
+  void dot(sf::Vector2f center, long radius, sf::Color c) {
+    auto const x = std::lround(center.x);
+    auto const y = std::lround(center.y);
+    for (auto dy = -radius; dy <= radius; ++dy) {
+      for (auto dx = -radius; dx <= radius; ++dx) blend(x + dx, y + dy, c);
+    }
+  }
+
+  /// @brief Copies the image stretched over the rectangle, nearest pixel.
+  void image(const sf::Image& source, sf::FloatRect area) {
+    auto const [w, h] = source.getSize();
+    for (auto y = std::lround(area.top);
+         y < std::lround(area.top + area.height); ++y) {
+      for (auto x = std::lround(area.left);
+           x < std::lround(area.left + area.width); ++x) {
+        auto const u = static_cast<float>(x) - area.left;
+        auto const v = static_cast<float>(y) - area.top;
+        auto const sx = std::min(
+            static_cast<unsigned>(u / area.width * static_cast<float>(w)),
+            w - 1);
+        auto const sy = std::min(
+            static_cast<unsigned>(v / area.height * static_cast<float>(h)),
+            h - 1);
+        blend(x, y, source.getPixel(sx, sy));
+      }
+    }
+  }
+
+  sf::Image toImage() const {
+    sf::Image image;
+    image.create(size_.width, size_.height, pixels_.data());
+    return image;
+  }
+};
+
+/// @brief Same layout as the viewer: the billiard fit in the image with a
+/// margin, the axis of the billiard in the middle.
+struct Layout {
+  float scale;
+  float originY;
+
+  Layout(const Border* border, RenderSize size) {
+    auto const width = static_cast<float>(size.width);
+    auto const height = static_cast<float>(size.height);
+    auto const margin = std::min({40.f, width / 10.f, height / 10.f});
+    auto const yRange =
+        static_cast<float>(std::max(border->r1(), border->r2()));
+    scale = std::min((width - 2 * margin) / static_cast<float>(border->xEnd()),
+                     (height - 2 * margin) / (2 * yRange));
+    originY = height / 2.f;
+  }
+
+  sf::Vector2f operator()(double x, double y) const {
+    return {static_cast<float>(x) * scale,
+            originY - static_cast<float>(y) * scale};
+  }
+};
+
+void drawBorders(Canvas& canvas, const Layout& layout, const Border* border) {
+  auto const L = border->xEnd();
+  canvas.line(layout(0., border->r1()), layout(L, border->r2()),
+              sf::Color::Yellow);
+  canvas.line(layout(0., -border->r1()), layout(L, -border->r2()),
+              sf::Color::Red);
+}
+
+}  // namespace
+
+sf::Image renderTrajectory(const std::vector<Particle>& collisions,
+                           const Border* border, RenderSize size,
+                           double fraction) {
+  Layout const layout{border, size};
+  Canvas canvas{size, sf::Color::Black};
+  canvas.line(layout(0., 0.), layout(border->xEnd(), 0.),
+              sf::Color(55, 55, 55, 120));
+  drawBorders(canvas, layout, border);
+  if (collisions.empty()) return canvas.toImage();
+
+  double total = 0.;
+  for (std::size_t i = 0; i + 1 < collisions.size(); ++i) {
+    total += std::hypot(collisions[i + 1].x - collisions[i].x,
+                        collisions[i + 1].y - collisions[i].y);
+  }
+
+  // the segments up to the given length, the last one possibly in part
+  auto left = std::clamp(fraction, 0., 1.) * total;
+  auto end = layout(collisions[0].x, collisions[0].y);
+  sf::Color const trail{60, 120, 255, 200};
+  for (std::size_t i = 0; i + 1 < collisions.size() && left > 0.; ++i) {
+    auto const& a = collisions[i];
+    auto const& b = collisions[i + 1];
+    auto const length = std::hypot(b.x - a.x, b.y - a.y);
+    auto const t = length > left ? left / length : 1.;
+    end = layout(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t);
+    canvas.line(layout(a.x, a.y), end, trail);
+    left -= length;
+  }
+  canvas.dot(end, 2, sf::Color::Red);
+  return canvas.toImage();
+}
+
+sf::Image renderOccupancy(const OccupancyGrid& grid, const Border* border,
+                          RenderSize size) {
+  Layout const layout{border, size};
+  Canvas canvas{size, sf::Color::Black};
+  if (!grid.empty()) {
+    auto const yRange = std::max(border->r1(), border->r2());
+    auto const topLeft = layout(0., yRange);
+    auto const bottomRight = layout(border->xEnd(), -yRange);
+    canvas.image(occupancyImage(grid, true),
+                 {topLeft, bottomRight - topLeft});
+  }
+  drawBorders(canvas, layout, border);
+  return canvas.toImage();
+}
+
+void saveImage(sf::Image image, const std::string& path, ThreadPool& pool) {
+  // std::function needs a copyable task
+  auto shared = std::make_shared<sf::Image>(std::move(image));
+  pool.submit([shared, path] {
+    if (!shared->saveToFile(path)) {
+      throw std::runtime_error("Impossible to write " + path);
+    }
+  });
+}
+
+void renderFrames(const std::vector<Particle>& collisions,
+                  const Border* border, const std::string& prefix,
+                  unsigned frames, RenderSize size, ThreadPool& pool) {
+  auto const inFlight = 2 * pool.size();
+  for (unsigned k = 0; k != frames; ++k) {
+    auto const fraction =
+        frames == 1 ? 1. : static_cast<double>(k) / (frames - 1);
+    auto number = std::to_string(k);
+    number.insert(0, 4 - std::min<std::size_t>(4, number.size()), '0');
+    saveImage(renderTrajectory(collisions, border, size, fraction),
+              prefix + number + ".png", pool);
+    if ((k + 1) % inFlight == 0) pool.wait();
+  }
+  pool.wait();
+}
+
+}  // namespace tb
@@ -0,0 +1,46 @@
+#ifndef RENDER_HPP
+#define RENDER_HPP
+
+#include <SFML/Graphics.hpp>
+#include <string>
+#include <vector>
+
+#include "threadpool.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief Size in pixels of a rendered image.
+struct RenderSize {
+  unsigned width = 1000;
+  unsigned height = 600;
+};
+
+/// @brief Draws the borders and the part of the trajectory covering the
+/// given fraction of its length, with the same layout as the viewer. The
+/// drawing is done in software into an sf::Image, so that no window nor
+/// OpenGL context is needed, e.g. on compute nodes.
+sf::Image renderTrajectory(const std::vector<Particle>& collisions,
+                           const Border* border, RenderSize size,
+                           double fraction = 1.);
+
+/// @brief Draws the occupancy grid as a heatmap over the billiard, with its
+/// borders, on a logarithmic scale.
+sf::Image renderOccupancy(const OccupancyGrid& grid, const Border* border,
+                          RenderSize size);
+
+/// @brief Writes an animation of the trajectory as frames PREFIX0000.png,
+/// PREFIX0001.png and so on, the particle advancing by the same length in
+/// each. Frames are encoded by the pool while the next ones are drawn, with
+/// at most two per thread waiting, so that memory stays bounded.
+void renderFrames(const std::vector<Particle>& collisions,
+                  const Border* border, const std::string& prefix,
+                  unsigned frames, RenderSize size, ThreadPool& pool);
+
+/// @brief Encodes the image to the file from the pool, taking ownership of
+/// it. Errors are reported by the wait() of the pool.
+void saveImage(sf::Image image, const std::string& path, ThreadPool& pool);
+
+}  // namespace tb
+
+#endif
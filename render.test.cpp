@@ -0,0 +1,150 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "doctest.h"
+#include "render.hpp"
+
+namespace {
+
+/// @brief Pixels of the image of the given colour.
+std::size_t countPixels(const sf::Image& image, sf::Color color) {
+  std::size_t n = 0;
+  auto const [w, h] = image.getSize();
+  for (unsigned y = 0; y != h; ++y) {
+    for (unsigned x = 0; x != w; ++x) n += image.getPixel(x, y) == color;
+  }
+  return n;
+}
+
+}  // namespace
+
+// images of 200 x 120 pixels: a margin of 12 pixels, the billiard centred
+// vertically (y = 0 on row 60)
+constexpr tb::RenderSize size{200, 120};
+
+TEST_CASE("Testing renderTrajectory() function") {
+  // 2.4 pixels per unit, the billiard ending on column 120
+  tb::StraightBorder border{20., 20., 50.};
+  tb::Particle p{0., 5., 0.6};
+  auto const positions = tb::computeSingleTrajectory(p, &border).positions();
+  auto const image = tb::renderTrajectory(positions, &border, size);
+  REQUIRE(image.getSize() == sf::Vector2u{200, 120});
+
+  // the trail is blended over the black background
+  sf::Color const trail{47, 94, 200};
+
+  SUBCASE("Borders and background") {
+    CHECK(image.getPixel(60, 12) == sf::Color::Yellow);
+    CHECK(image.getPixel(60, 108) == sf::Color::Red);
+    CHECK(image.getPixel(180, 12) == sf::Color::Black);
+    CHECK(image.getPixel(199, 119) == sf::Color::Black);
+  }
+
+  SUBCASE("The whole trajectory is drawn, ending with the particle") {
+    // each column of the billiard is crossed by the trail, apart from the
+    // few where it meets a border or the axis
+    unsigned covered = 0;
+    for (unsigned x = 0; x != 120; ++x) {
+      for (unsigned y = 0; y != 120; ++y) {
+        if (image.getPixel(x, y) == trail) {
+          ++covered;
+          break;
+        }
+      }
+    }
+    CHECK(covered > 110);
+
+    auto const& end = positions.back();
+    auto const x = static_cast<unsigned>(std::lround(end.x * 2.4));
+    auto const y = static_cast<unsigned>(std::lround(60. - end.y * 2.4));
+    CHECK(image.getPixel(x, y) == sf::Color::Red);
+  }
+
+  SUBCASE("A fraction of the trajectory") {
+    auto const half = tb::renderTrajectory(positions, &border, size, 0.5);
+    auto const none = tb::renderTrajectory(positions, &border, size, 0.);
+    auto const all = countPixels(image, trail);
+    CHECK(countPixels(half, trail) > all / 3);
+    CHECK(countPixels(half, trail) < 2 * all / 3);
+    CHECK(countPixels(none, trail) == 0);
+  }
+}
+
+TEST_CASE("Testing renderOccupancy() function") {
+  // cells of 1 x 1 over [0, 10] x [-5, 5], of 9.6 x 9.6 pixels from the top
+  // left corner (0, 12) of the billiard
+  tb::StraightBorder border{5., 5., 10.};
+  tb::OccupancyGrid grid{10, 10, border};
+  grid.addSegment({0.5, 0.5, 0.}, {9.5, 0.5, 0.});
+  auto const image = tb::renderOccupancy(grid, &border, size);
+  REQUIRE(image.getSize() == sf::Vector2u{200, 120});
+
+  // the most visited cells are the hottest, the empty ones the coldest
+  CHECK(image.getPixel(48, 55) == sf::Color(252, 255, 164));
+  CHECK(image.getPixel(5, 55) == sf::Color(252, 255, 164));
+  CHECK(image.getPixel(48, 80) == sf::Color(0, 0, 4));
+  CHECK(image.getPixel(48, 30) == sf::Color(0, 0, 4));
+  // the borders over the heatmap, nothing outside the billiard
+  CHECK(image.getPixel(48, 12) == sf::Color::Yellow);
+  CHECK(image.getPixel(48, 108) == sf::Color::Red);
+  CHECK(image.getPixel(150, 55) == sf::Color::Black);
+
+  SUBCASE("An empty grid only draws the borders") {
+    auto const empty = tb::renderOccupancy({}, &border, size);
+    CHECK(empty.getPixel(48, 55) == sf::Color::Black);
+    CHECK(empty.getPixel(48, 12) == sf::Color::Yellow);
+  }
+}
+
+TEST_CASE("Testing saveImage() and renderFrames() functions") {
+  auto const directory = std::filesystem::temp_directory_path();
+  tb::StraightBorder border{20., 20., 50.};
+  tb::Particle p{0., 5., 0.6};
+  auto const positions = tb::computeSingleTrajectory(p, &border).positions();
+  tb::ThreadPool pool{2};
+
+  SUBCASE("A PNG file of the size of the image") {
+    auto const path = (directory / "tb_render.test.png").string();
+    tb::saveImage(tb::renderTrajectory(positions, &border, size), path, pool);
+    pool.wait();
+
+    std::ifstream in{path, std::ios::binary};
+    std::string const bytes{std::istreambuf_iterator<char>{in}, {}};
+    REQUIRE(bytes.size() > 24);
+    CHECK(bytes.substr(0, 8) == "\x89PNG\r\n\x1a\n");
+    CHECK(bytes.substr(12, 4) == "IHDR");
+    // width and height, big-endian
+    auto const word = [&bytes](std::size_t at) {
+      unsigned v = 0;
+      for (std::size_t i = at; i != at + 4; ++i) {
+        v = v << 8 | static_cast<unsigned char>(bytes[i]);
+      }
+      return v;
+    };
+    CHECK(word(16) == 200);
+    CHECK(word(20) == 120);
+    std::filesystem::remove(path);
+  }
+
+  SUBCASE("One file per frame") {
+    auto const prefix = (directory / "tb_render.test_").string();
+    tb::renderFrames(positions, &border, prefix, 3, size, pool);
+    for (auto const* number : {"0000", "0001", "0002"}) {
+      auto const path = prefix + number + ".png";
+      CHECK(std::filesystem::file_size(path) > 0);
+      std::filesystem::remove(path);
+    }
+    CHECK(!std::filesystem::exists(prefix + "0003.png"));
+  }
+
+  SUBCASE("Errors are reported by the pool") {
+    auto const path = (directory / "tb_render.missing" / "a.png").string();
+    tb::saveImage(tb::renderTrajectory(positions, &border, size), path, pool);
+    CHECK_THROWS(pool.wait());
+  }
+}
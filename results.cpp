@@ -0,0 +1,529 @@
+#include "results.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+namespace tb {
+
+// the files are written and mapped in native byte order
+static_assert(std::endian::native == std::endian::little);
+
+namespace {
+
+constexpr Column allColumns[] = {FinalY, FinalTheta, InitialY, InitialTheta};
+
+std::size_t columnCount(std::uint32_t columns) {
+  return static_cast<std::size_t>(
+      std::count_if(std::begin(allColumns), std::end(allColumns),
+                    [=](Column c) { return (columns & c) != 0; }));
+}
+
+void writeAt(int fd, const void* data, std::size_t size, std::uint64_t offset) {
+  auto bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    auto const n = ::pwrite(fd, bytes, size, static_cast<off_t>(offset));
+    if (n == -1) {
+      throw std::runtime_error{"Error while writing results"};
+    }
+    bytes += n;
+    size -= static_cast<std::size_t>(n);
+    offset += static_cast<std::uint64_t>(n);
+  }
+}
+
+void writeColumn(std::ofstream& out, const Sample& sample) {
+  auto const& values = sample.values();
+  out.write(reinterpret_cast<const char*>(values.data()),
+            static_cast<std::streamsize>(values.size() * sizeof(double)));
+}
+
+/// @brief Columns of the retained particles with their names.
+struct NamedColumns {
+  std::vector<std::span<const double>> columns;
+  std::vector<std::string> names;
+};
+
+NamedColumns namedColumns(const MultipleResult& result) {
+  auto const rows = result.finalY.values().size();
+  NamedColumns named{{result.finalY.values(), result.finalTheta.values()},
+                     {"Yf", "Thetaf"}};
+  if (result.initialY.values().size() == rows && rows > 0) {
+    named.columns.emplace_back(result.initialY.values());
+    named.columns.emplace_back(result.initialTheta.values());
+    named.names.emplace_back("Y0");
+    named.names.emplace_back("Theta0");
+  }
+  return named;
+}
+
+/// @brief The .npy preamble (magic, version 1.0, header length, header dict),
+/// padded so that the data starts at a multiple of 64 bytes.
+std::string npyHeader(const std::string& descr, std::size_t rows) {
+  std::string dict = "{'descr': " + descr +
+                     ", 'fortran_order': False, 'shape': (" +
+                     std::to_string(rows) + ",), }";
+  auto const unpadded = 10 + dict.size() + 1;
+  dict.append((64 - unpadded % 64) % 64, ' ');
+  dict.push_back('\n');
+  assert(dict.size() <= UINT16_MAX);
+
+  auto const length = static_cast<std::uint16_t>(dict.size());
+  std::string header = "\x93NUMPY\x01";
+  header.push_back('\0');
+  header.push_back(static_cast<char>(length & 0xff));
+  header.push_back(static_cast<char>(length >> 8));
+  return header + dict;
+}
+
+template <class T>
+void writeNpyColumn(const std::string& path, std::span<const T> values,
+                    const std::string& descr) {
+  std::ofstream out{path, std::ios::binary};
+  if (!out) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+  auto const header = npyHeader(descr, values.size());
+  out.write(header.data(), static_cast<std::streamsize>(header.size()));
+  out.write(reinterpret_cast<const char*>(values.data()),
+            static_cast<std::streamsize>(values.size_bytes()));
+  if (!out) {
+    throw std::runtime_error{"Error while writing " + path};
+  }
+}
+
+std::uint32_t crc32(std::uint32_t crc, const void* data, std::size_t size) {
+  static auto const table = [] {
+    std::array<std::uint32_t, 256> t{};
+    for (std::uint32_t i = 0; i != 256; ++i) {
+      auto c = i;
+      for (int k = 0; k != 8; ++k) {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  auto bytes = static_cast<const unsigned char*>(data);
+  crc = ~crc;
+  for (std::size_t i = 0; i != size; ++i) {
+    crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/// @brief Little-endian integer fields of the zip records.
+void put(std::string& out, std::uint32_t value, int bytes) {
+  for (int i = 0; i != bytes; ++i) {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+}  // namespace
+
+ResultsHeader makeResultsHeader(const Border& border,
+                                const EnsembleConfig& config,
+                                const MultipleResult& result) {
+  ResultsHeader header{};
+  std::copy(std::begin(resultsMagic), std::end(resultsMagic), header.magic);
+  header.version = resultsVersion;
+  header.columns = FinalY | FinalTheta;
+  if (config.keepInitial) header.columns |= InitialY | InitialTheta;
+  header.r1 = border.r1();
+  header.r2 = border.r2();
+  header.l = border.xEnd();
+  header.Y0_mean = config.Y0_mean;
+  header.Y0_err = std::abs(config.Y0_err);
+  header.Theta0_mean = config.Theta0_mean;
+  header.Theta0_err = std::abs(config.Theta0_err);
+  header.seed = config.seed;
+  header.N = static_cast<std::uint64_t>(config.N);
+  header.accepted = static_cast<std::uint64_t>(result.accepted);
+  header.rejected = static_cast<std::uint64_t>(result.rejected);
+  header.rows = result.finalY.values().size();
+  header.capacity = header.rows;
+  return header;
+}
+
+void writeResults(const std::string& path, const Border& border,
+                  const EnsembleConfig& config, const MultipleResult& result) {
+  auto const header = makeResultsHeader(border, config, result);
+  assert(result.finalTheta.values().size() == header.rows);
+
+  std::ofstream out{path, std::ios::binary};
+  if (!out) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  writeColumn(out, result.finalY);
+  writeColumn(out, result.finalTheta);
+  if (header.columns & InitialY) {
+    assert(result.initialY.values().size() == header.rows);
+    assert(result.initialTheta.values().size() == header.rows);
+    writeColumn(out, result.initialY);
+    writeColumn(out, result.initialTheta);
+  }
+
+  if (!out) {
+    throw std::runtime_error{"Error while writing " + path};
+  }
+}
+
+void writeText(const std::string& path, const MultipleResult& result,
+               TextFormat format, unsigned threads) {
+  auto const rows = result.finalY.values().size();
+  auto const [columns, names] = namedColumns(result);
+
+  std::ofstream out{path, std::ios::binary};
+  if (!out) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+
+  if (format.header) {
+    for (std::size_t c = 0; c != names.size(); ++c) {
+      if (c != 0) out << format.separator;
+      out << names[c];
+    }
+    out << '\n';
+  }
+
+  // the workers are started once for the whole file
+  ThreadPool pool{std::max(threads, 1u)};
+  writeRows(out, columns, rows, format, pool);
+
+  if (!out) {
+    throw std::runtime_error{"Error while writing " + path};
+  }
+}
+
+void writeNpy(const std::string& path, std::span<const double> values) {
+  writeNpyColumn(path, values, "'<f8'");
+}
+
+void writeNpy(const std::string& path, std::span<const float> values) {
+  writeNpyColumn(path, values, "'<f4'");
+}
+
+void writeNpyRecords(const std::string& path, const MultipleResult& result) {
+  auto const rows = result.finalY.values().size();
+  auto const [columns, names] = namedColumns(result);
+
+  std::string descr = "[";
+  for (auto const& name : names) descr += "('" + name + "', '<f8'), ";
+  descr += "]";
+
+  std::ofstream out{path, std::ios::binary};
+  if (!out) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+  auto const header = npyHeader(descr, rows);
+  out.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+  // the records interleave the columns, so they go through a bounded buffer
+  constexpr std::size_t blockRows = 1 << 14;
+  std::vector<double> buffer;
+  buffer.reserve(blockRows * columns.size());
+  for (std::size_t first = 0; first < rows; first += blockRows) {
+    buffer.clear();
+    for (auto i = first; i != std::min(rows, first + blockRows); ++i) {
+      for (auto const& column : columns) buffer.push_back(column[i]);
+    }
+    out.write(reinterpret_cast<const char*>(buffer.data()),
+              static_cast<std::streamsize>(buffer.size() * sizeof(double)));
+  }
+
+  if (!out) {
+    throw std::runtime_error{"Error while writing " + path};
+  }
+}
+
+void writeNpz(const std::string& path, const MultipleResult& result) {
+  auto const [columns, names] = namedColumns(result);
+
+  std::ofstream out{path, std::ios::binary};
+  if (!out) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+
+  // each array is a stored (uncompressed) zip entry; its CRC is computed in a
+  // first pass over the buffer, then the data is written straight from it
+  std::string directory;
+  std::uint32_t offset = 0;
+  for (std::size_t c = 0; c != columns.size(); ++c) {
+    auto const name = names[c] + ".npy";
+    auto const header = npyHeader("'<f8'", columns[c].size());
+    auto const size = header.size() + columns[c].size_bytes();
+    if (offset + 30 + name.size() + size > UINT32_MAX) {
+      throw std::runtime_error{"Columns too large for " + path};
+    }
+    auto crc = crc32(0, header.data(), header.size());
+    crc = crc32(crc, columns[c].data(), columns[c].size_bytes());
+    auto const size32 = static_cast<std::uint32_t>(size);
+
+    std::string common;
+    put(common, 20, 2);    // version needed to extract
+    put(common, 0, 2);     // flags
+    put(common, 0, 2);     // stored
+    put(common, 0, 2);     // time
+    put(common, 0x21, 2);  // date, 1980-01-01
+    put(common, crc, 4);
+    put(common, size32, 4);
+    put(common, size32, 4);
+    put(common, static_cast<std::uint32_t>(name.size()), 2);
+    put(common, 0, 2);  // extra field length
+
+    std::string local;
+    put(local, 0x04034b50, 4);
+    local += common + name;
+    out.write(local.data(), static_cast<std::streamsize>(local.size()));
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    out.write(reinterpret_cast<const char*>(columns[c].data()),
+              static_cast<std::streamsize>(columns[c].size_bytes()));
+
+    put(directory, 0x02014b50, 4);
+    put(directory, 20, 2);  // version made by
+    directory += common;
+    put(directory, 0, 2);  // comment length
+    put(directory, 0, 2);  // disk number
+    put(directory, 0, 2);  // internal attributes
+    put(directory, 0, 4);  // external attributes
+    put(directory, offset, 4);
+    directory += name;
+
+    offset += static_cast<std::uint32_t>(local.size()) + size32;
+  }
+
+  std::string end;
+  put(end, 0x06054b50, 4);
+  put(end, 0, 2);  // disk number
+  put(end, 0, 2);  // disk with the directory
+  put(end, static_cast<std::uint32_t>(columns.size()), 2);
+  put(end, static_cast<std::uint32_t>(columns.size()), 2);
+  put(end, static_cast<std::uint32_t>(directory.size()), 4);
+  put(end, offset, 4);
+  put(end, 0, 2);
+  out.write(directory.data(), static_cast<std::streamsize>(directory.size()));
+  out.write(end.data(), static_cast<std::streamsize>(end.size()));
+
+  if (!out) {
+    throw std::runtime_error{"Error while writing " + path};
+  }
+}
+
+ChunkedWriter::ChunkedWriter(const std::string& path, const Border& border,
+                             const EnsembleConfig& config,
+                             std::size_t chunkRows, bool resume)
+    : chunkRows_{chunkRows} {
+  assert(chunkRows_ > 0);
+  header_ = makeResultsHeader(border, config, MultipleResult{});
+  header_.accepted = 0;
+  header_.rejected = 0;
+  header_.rows = 0;
+  header_.capacity = header_.N;
+
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC),
+               0644);
+  if (fd_ == -1) {
+    throw std::runtime_error{"Impossible to open file!"};
+  }
+  auto const size = sizeof(ResultsHeader) + columnCount(header_.columns) *
+                                                header_.capacity *
+                                                sizeof(double);
+  if (::ftruncate(fd_, static_cast<off_t>(size)) == -1) {
+    ::close(fd_);
+    throw std::runtime_error{"Impossible to allocate " + path};
+  }
+
+  for (auto chunk : {&filling_, &writing_}) {
+    for (auto& column : chunk->columns) column.reserve(chunkRows_);
+  }
+  thread_ = std::thread{&ChunkedWriter::writeLoop, this};
+}
+
+ChunkedWriter::~ChunkedWriter() {
+  try {
+    close();
+  } catch (...) {
+  }
+}
+
+void ChunkedWriter::writeLoop() {
+  std::unique_lock lock{mutex_};
+  while (true) {
+    cv_.wait(lock, [this] { return pending_ || done_; });
+    if (!pending_) return;
+
+    // the chunk being filled is not touched here, so the lock can be released
+    // while writing
+    lock.unlock();
+    try {
+      // the columns present are always the first ones
+      for (std::size_t i = 0; i != columnCount(header_.columns); ++i) {
+        auto const& column = writing_.columns[i];
+        auto const offset = sizeof(ResultsHeader) +
+                            (i * header_.capacity + writing_.first) *
+                                sizeof(double);
+        writeAt(fd_, column.data(), column.size() * sizeof(double), offset);
+      }
+    } catch (...) {
+      lock.lock();
+      error_ = std::current_exception();
+      pending_ = false;
+      cv_.notify_all();
+      continue;
+    }
+    lock.lock();
+    pending_ = false;
+    cv_.notify_all();
+  }
+}
+
+void ChunkedWriter::submit() {
+  wait();
+  std::lock_guard lock{mutex_};
+  header_.rows += filling_.rows;
+  std::swap(filling_, writing_);
+  pending_ = true;
+  cv_.notify_all();
+
+  filling_.first = header_.rows;
+  filling_.rows = 0;
+  for (auto& column : filling_.columns) column.clear();
+}
+
+void ChunkedWriter::wait() {
+  std::unique_lock lock{mutex_};
+  cv_.wait(lock, [this] { return !pending_; });
+  if (error_) std::rethrow_exception(error_);
+}
+
+void ChunkedWriter::accept(double Y0, double Theta0, double Yf, double Thetaf) {
+  assert(fd_ != -1 && rows() < header_.capacity);
+  filling_.columns[0].push_back(Yf);
+  filling_.columns[1].push_back(Thetaf);
+  if (header_.columns & InitialY) {
+    filling_.columns[2].push_back(Y0);
+    filling_.columns[3].push_back(Theta0);
+  }
+  if (++filling_.rows == chunkRows_) submit();
+}
+
+void ChunkedWriter::flush() {
+  if (filling_.rows > 0) submit();
+  wait();
+  if (::fdatasync(fd_) == -1) {
+    throw std::runtime_error{"Impossible to write results"};
+  }
+}
+
+void ChunkedWriter::resume(std::uint64_t accepted) {
+  assert(rows() == 0 && accepted <= header_.capacity);
+  header_.rows = accepted;
+  filling_.first = accepted;
+}
+
+void ChunkedWriter::close() {
+  if (fd_ == -1) return;
+  if (filling_.rows > 0) submit();
+
+  {
+    std::unique_lock lock{mutex_};
+    cv_.wait(lock, [this] { return !pending_; });
+    done_ = true;
+    cv_.notify_all();
+  }
+  thread_.join();
+
+  auto const fd = std::exchange(fd_, -1);
+  if (!error_) {
+    header_.accepted = header_.rows;
+    header_.rejected = header_.N - header_.rows;
+    try {
+      writeAt(fd, &header_, sizeof(header_), 0);
+    } catch (...) {
+      error_ = std::current_exception();
+    }
+  }
+  ::close(fd);
+  if (error_) std::rethrow_exception(error_);
+}
+
+ResultsFile::ResultsFile(const std::string& path) {
+  auto const fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw std::runtime_error{"Impossible to open " + path};
+  }
+
+  struct stat info {};
+  if (::fstat(fd, &info) == -1 ||
+      static_cast<std::size_t>(info.st_size) < sizeof(ResultsHeader)) {
+    ::close(fd);
+    throw std::runtime_error{path + " is not a results file"};
+  }
+
+  size_ = static_cast<std::size_t>(info.st_size);
+  data_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data_ == MAP_FAILED) {
+    data_ = nullptr;
+    throw std::runtime_error{"Impossible to map " + path};
+  }
+
+  auto const& h = header();
+  auto const columns = columnCount(h.columns);
+  if (std::memcmp(h.magic, resultsMagic, sizeof(resultsMagic)) != 0 ||
+      h.version != resultsVersion ||
+      h.rows > h.capacity ||
+      size_ != sizeof(ResultsHeader) + columns * h.capacity * sizeof(double)) {
+    ::munmap(data_, size_);
+    data_ = nullptr;
+    throw std::runtime_error{path + " is not a valid results file"};
+  }
+}
+
+ResultsFile::~ResultsFile() {
+  if (data_ != nullptr) ::munmap(data_, size_);
+}
+
+ResultsFile::ResultsFile(ResultsFile&& other) noexcept
+    : data_{std::exchange(other.data_, nullptr)},
+      size_{std::exchange(other.size_, 0)} {}
+
+ResultsFile& ResultsFile::operator=(ResultsFile&& other) noexcept {
+  std::swap(data_, other.data_);
+  std::swap(size_, other.size_);
+  return *this;
+}
+
+const ResultsHeader& ResultsFile::header() const {
+  return *static_cast<const ResultsHeader*>(data_);
+}
+
+std::span<const double> ResultsFile::column(Column c) const {
+  auto const& h = header();
+  if ((h.columns & c) == 0) return {};
+
+  // columns are stored in the order of their flags
+  std::size_t index = 0;
+  for (auto other : allColumns) {
+    if (other == c) break;
+    if (h.columns & other) ++index;
+  }
+
+  auto const first = reinterpret_cast<const double*>(
+      static_cast<const char*>(data_) + sizeof(ResultsHeader));
+  return {first + index * h.capacity, static_cast<std::size_t>(h.rows)};
+}
+
+}  // namespace tb
@@ -0,0 +1,172 @@
+#ifndef RESULTS_HPP
+#define RESULTS_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "textformat.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief Columns that may be present in a results file, as bit flags.
+enum Column : std::uint32_t {
+  FinalY = 1,
+  FinalTheta = 2,
+  InitialY = 4,
+  InitialTheta = 8
+};
+
+/// @brief Fixed-size header of a binary results file. It is followed by
+/// `capacity` doubles for each column present, in the order of the Column
+/// flags, of which the first `rows` are valid. All the fields are 8-byte
+/// aligned and the header is 128 bytes long, so that the columns can be read
+/// in place from a memory-mapped file.
+struct ResultsHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t columns;
+  double r1;
+  double r2;
+  double l;
+  double Y0_mean;
+  double Y0_err;
+  double Theta0_mean;
+  double Theta0_err;
+  std::uint64_t seed;
+  std::uint64_t N;
+  std::uint64_t accepted;
+  std::uint64_t rejected;
+  std::uint64_t rows;
+  std::uint64_t capacity;
+  std::uint64_t reserved;
+};
+
+static_assert(sizeof(ResultsHeader) == 128);
+
+inline constexpr char resultsMagic[8] = {'T', 'B', 'R', 'E',
+                                         'S', 'U', 'L', 'T'};
+inline constexpr std::uint32_t resultsVersion = 1;
+
+ResultsHeader makeResultsHeader(const Border& border,
+                                const EnsembleConfig& config,
+                                const MultipleResult& result);
+
+/// @brief Writes the retained final states (and the initial conditions, if
+/// they were recorded) as a binary columnar file. Values are copied straight
+/// from the samples, without any formatting.
+void writeResults(const std::string& path, const Border& border,
+                  const EnsembleConfig& config, const MultipleResult& result);
+
+/// @brief Writes the retained final states (and the initial conditions, if
+/// they were recorded) as text. Numbers are formatted with std::to_chars into
+/// large buffers, written in bulk; consecutive blocks of lines are formatted
+/// in parallel by a pool of that many threads and written in order.
+void writeText(const std::string& path, const MultipleResult& result,
+               TextFormat format = {}, unsigned threads = 1);
+
+/// @brief Writes a column as a NumPy .npy array, with the values copied
+/// straight from the buffer after the header.
+void writeNpy(const std::string& path, std::span<const double> values);
+void writeNpy(const std::string& path, std::span<const float> values);
+
+/// @brief Writes the retained particles as a NumPy structured array, with
+/// fields Yf and Thetaf (and Y0 and Theta0, if recorded).
+void writeNpyRecords(const std::string& path, const MultipleResult& result);
+
+/// @brief Writes the columns of the retained particles as the arrays Yf,
+/// Thetaf (and Y0, Theta0) of an uncompressed .npz archive, readable with
+/// numpy.load. Each column must be smaller than 4 GiB.
+void writeNpz(const std::string& path, const MultipleResult& result);
+
+/// @brief Streams accepted particles to a results file while they are being
+/// generated. Rows are collected in a chunk, which is written at its place in
+/// each column by a background thread while the next chunk is being filled.
+/// Each column has room for all the N particles of the run; the part left
+/// unwritten by rejected particles is a hole in the file and takes no space.
+/// A writer opened with resume keeps the content of an existing file, so that
+/// a run resumed from a checkpoint continues the file of the interrupted one.
+class ChunkedWriter : public ParticleSink {
+  struct Chunk {
+    std::vector<double> columns[4];
+    std::size_t rows{0};
+    std::uint64_t first{0};
+  };
+
+  int fd_{-1};
+  ResultsHeader header_{};
+  std::size_t chunkRows_;
+  Chunk filling_{};
+  Chunk writing_{};
+  bool pending_{false};
+  bool done_{false};
+  std::exception_ptr error_{};
+  std::mutex mutex_{};
+  std::condition_variable cv_{};
+  std::thread thread_{};
+
+  void writeLoop();
+  void submit();
+  void wait();
+
+ public:
+  explicit ChunkedWriter(const std::string& path, const Border& border,
+                         const EnsembleConfig& config,
+                         std::size_t chunkRows = 1 << 16, bool resume = false);
+  ~ChunkedWriter() override;
+
+  ChunkedWriter(const ChunkedWriter&) = delete;
+  ChunkedWriter& operator=(const ChunkedWriter&) = delete;
+
+  void accept(double Y0, double Theta0, double Yf, double Thetaf) override;
+
+  /// @brief Writes the partial chunk and waits until it is on disk.
+  void flush() override;
+
+  /// @brief Continues after the rows accepted before the checkpoint.
+  void resume(std::uint64_t accepted) override;
+
+  /// @brief Writes the last partial chunk and the final counts. Particles not
+  /// accepted by the end of the run are counted as rejected.
+  void close();
+
+  std::uint64_t rows() const { return header_.rows + filling_.rows; }
+};
+
+/// @brief Read-only view of a binary results file, mapped into memory.
+/// The columns are spans over the mapping and stay valid as long as the
+/// ResultsFile object.
+class ResultsFile {
+  void* data_{nullptr};
+  std::size_t size_{0};
+
+  std::span<const double> column(Column c) const;
+
+ public:
+  explicit ResultsFile(const std::string& path);
+  ~ResultsFile();
+
+  ResultsFile(const ResultsFile&) = delete;
+  ResultsFile& operator=(const ResultsFile&) = delete;
+  ResultsFile(ResultsFile&& other) noexcept;
+  ResultsFile& operator=(ResultsFile&& other) noexcept;
+
+  const ResultsHeader& header() const;
+  bool has(Column c) const { return (header().columns & c) != 0; }
+
+  std::span<const double> finalY() const { return column(FinalY); }
+  std::span<const double> finalTheta() const { return column(FinalTheta); }
+  std::span<const double> initialY() const { return column(InitialY); }
+  std::span<const double> initialTheta() const { return column(InitialTheta); }
+};
+
+}  // namespace tb
+
+#endif
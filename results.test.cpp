@@ -0,0 +1,295 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <sstream>
+
+#include "doctest.h"
+#include "results.hpp"
+
+TEST_CASE("Testing the binary results file") {
+  auto const path =
+      (std::filesystem::temp_directory_path() / "tb_results.test.tbr").string();
+  auto border = tb::createBorder(20., 15., 50.);
+
+  SUBCASE("Writing and reading back the final states") {
+    tb::EnsembleConfig config{1000, 5., 0.01, 0.785, 0.001, 42};
+    auto result = tb::runMultipleSimulations(config, border.get());
+    tb::writeResults(path, *border, config, result);
+
+    tb::ResultsFile file{path};
+    auto const& header = file.header();
+    CHECK(header.r1 == 20.);
+    CHECK(header.r2 == 15.);
+    CHECK(header.l == 50.);
+    CHECK(header.Y0_mean == 5.);
+    CHECK(header.Theta0_err == 0.001);
+    CHECK(header.seed == 42);
+    CHECK(header.N == 1000);
+    CHECK(header.accepted == static_cast<std::uint64_t>(result.accepted));
+    CHECK(header.rejected == static_cast<std::uint64_t>(result.rejected));
+    CHECK(header.rows == result.finalY.values().size());
+    CHECK(file.has(tb::FinalY));
+    CHECK(!file.has(tb::InitialY));
+    CHECK(file.initialY().empty());
+
+    auto finalY = file.finalY();
+    auto finalTheta = file.finalTheta();
+    REQUIRE(finalY.size() == result.finalY.values().size());
+    CHECK(std::equal(finalY.begin(), finalY.end(),
+                     result.finalY.values().begin()));
+    CHECK(std::equal(finalTheta.begin(), finalTheta.end(),
+                     result.finalTheta.values().begin()));
+  }
+
+  SUBCASE("Initial conditions are written when recorded") {
+    tb::EnsembleConfig config{1000, 5., 0.01, 0.785, 0.001, 7, 0, true};
+    auto result = tb::runMultipleSimulations(config, border.get());
+    tb::writeResults(path, *border, config, result);
+
+    tb::ResultsFile file{path};
+    CHECK(file.has(tb::InitialTheta));
+    auto initialY = file.initialY();
+    auto initialTheta = file.initialTheta();
+    REQUIRE(initialY.size() == result.initialY.values().size());
+    CHECK(std::equal(initialY.begin(), initialY.end(),
+                     result.initialY.values().begin()));
+    CHECK(std::equal(initialTheta.begin(), initialTheta.end(),
+                     result.initialTheta.values().begin()));
+    CHECK(file.finalY()[3] == result.finalY.values()[3]);
+  }
+
+  SUBCASE("An erased result is written without stale counts") {
+    tb::EnsembleConfig config{1000, 5., 0.01, 0.785, 0.001, 7, 0, true};
+    config.occupancyWidth = 10;
+    config.occupancyHeight = 10;
+    auto result = tb::runMultipleSimulations(config, border.get());
+    REQUIRE(!result.initialY.values().empty());
+    result = {};
+    CHECK(result.occupancy.empty());
+    tb::writeResults(path, *border, config, result);
+
+    tb::ResultsFile file{path};
+    CHECK(file.header().accepted == 0);
+    CHECK(file.header().rejected == 0);
+    CHECK(file.header().rows == 0);
+    CHECK(file.finalY().empty());
+    CHECK(file.initialTheta().empty());
+  }
+
+    SUBCASE("Same seed, same results") {
+    tb::EnsembleConfig config{1000, 5., 0.01, 0.785, 0.001, 42};
+    auto first = tb::runMultipleSimulations(config, border.get());
+    auto second = tb::runMultipleSimulations(config, border.get());
+    CHECK(first.finalY.values() == second.finalY.values());
+  }
+
+  SUBCASE("Streaming the accepted particles while they are generated") {
+    tb::EnsembleConfig config{1000, 5., 0.01, 0.785, 0.001, 11, 0, true};
+    tb::ChunkedWriter writer{path, *border, config, 64};
+    config.sink = &writer;
+    auto result = tb::runMultipleSimulations(config, border.get());
+    CHECK(writer.rows() == static_cast<std::uint64_t>(result.accepted));
+    writer.close();
+
+    tb::ResultsFile file{path};
+    CHECK(file.header().accepted ==
+          static_cast<std::uint64_t>(result.accepted));
+    CHECK(file.header().rejected ==
+          static_cast<std::uint64_t>(result.rejected));
+    CHECK(file.header().capacity == 1000);
+    auto finalTheta = file.finalTheta();
+    auto initialY = file.initialY();
+    REQUIRE(finalTheta.size() == result.finalTheta.values().size());
+    CHECK(std::equal(finalTheta.begin(), finalTheta.end(),
+                     result.finalTheta.values().begin()));
+    CHECK(std::equal(initialY.begin(), initialY.end(),
+                     result.initialY.values().begin()));
+  }
+
+  SUBCASE("Streaming with a bounded reservoir in memory") {
+    tb::EnsembleConfig config{5000, 0., 5., 0.3, 0.1, 3, 10};
+    tb::ChunkedWriter writer{path, *border, config, 100};
+    config.sink = &writer;
+    auto result = tb::runMultipleSimulations(config, border.get());
+    writer.close();
+
+    tb::ResultsFile file{path};
+    CHECK(result.finalY.values().size() == 10);
+    CHECK(file.finalY().size() == static_cast<std::size_t>(result.accepted));
+    auto finalY = file.finalY();
+    auto mean = std::accumulate(finalY.begin(), finalY.end(), 0.) /
+                static_cast<double>(finalY.size());
+    CHECK(mean == doctest::Approx(result.finalY.statistics().mean));
+  }
+
+  SUBCASE("Streaming a run resumed from a checkpoint") {
+    auto const checkpoint = path + ".checkpoint";
+    std::filesystem::remove(checkpoint);
+    // all the values are in the file, the run only keeps a reservoir
+    tb::EnsembleConfig config{2 * tb::ensembleBlock + 10, 5., 0.01, 0.785,
+                              0.001, 8, 1000, true};
+    auto const whole = path + ".whole";
+    {
+      tb::ChunkedWriter writer{whole, *border, config, 1000};
+      config.sink = &writer;
+      tb::runMultipleSimulations(config, border.get());
+      writer.close();
+    }
+
+    // forwards to the writer, and stops the run in its second block
+    struct Interrupt : tb::ParticleSink {
+      tb::ParticleSink* next;
+      int left = tb::ensembleBlock + 500;
+      void accept(double Y0, double Theta0, double Yf, double Thetaf) override {
+        if (--left == 0) throw std::runtime_error("Interrupted");
+        next->accept(Y0, Theta0, Yf, Thetaf);
+      }
+      void flush() override { next->flush(); }
+    };
+
+    config.checkpoint = checkpoint;
+    config.checkpointInterval = 0.;
+    {
+      tb::ChunkedWriter writer{path, *border, config, 1000};
+      Interrupt interrupt{};
+      interrupt.next = &writer;
+      config.sink = &interrupt;
+      CHECK_THROWS(tb::runMultipleSimulations(config, border.get()));
+    }
+    {
+      tb::ChunkedWriter writer{path, *border, config, 1000, true};
+      config.sink = &writer;
+      tb::runMultipleSimulations(config, border.get());
+      writer.close();
+    }
+
+    tb::ResultsFile expected{whole};
+    tb::ResultsFile file{path};
+    CHECK(file.header().accepted == expected.header().accepted);
+    CHECK(file.header().rejected == expected.header().rejected);
+    for (auto column : {&tb::ResultsFile::finalY, &tb::ResultsFile::finalTheta,
+                        &tb::ResultsFile::initialY,
+                        &tb::ResultsFile::initialTheta}) {
+      auto a = (file.*column)();
+      auto b = (expected.*column)();
+      CHECK(std::equal(a.begin(), a.end(), b.begin(), b.end()));
+    }
+    std::filesystem::remove(whole);
+  }
+
+  SUBCASE("Text export reads back to the same values") {
+    tb::EnsembleConfig config{100000, 5., 0.01, 0.785, 0.001, 5, 0, true};
+    auto result = tb::runMultipleSimulations(config, border.get());
+
+    for (unsigned threads : {1u, 3u}) {
+      tb::writeText(path, result, tb::csvFormat, threads);
+      std::ifstream in{path};
+      std::string line;
+      std::getline(in, line);
+      CHECK(line == "Yf,Thetaf,Y0,Theta0");
+
+      std::size_t rows = 0;
+      bool same = true;
+      while (std::getline(in, line)) {
+        std::istringstream fields{line};
+        std::string field;
+        for (auto const* sample : {&result.finalY, &result.finalTheta,
+                                   &result.initialY, &result.initialTheta}) {
+          std::getline(fields, field, ',');
+          same = same && std::stod(field) == sample->values()[rows];
+        }
+        ++rows;
+      }
+      CHECK(same);
+      CHECK(rows == result.finalY.values().size());
+    }
+  }
+
+  SUBCASE("Text export with a fixed precision") {
+    tb::MultipleResult result{};
+    result.finalY.add(1. / 3.);
+    result.finalTheta.add(-2.5e-7);
+    tb::writeText(path, result, {' ', 4});
+    std::ifstream in{path};
+    std::string line;
+    std::getline(in, line);
+    CHECK(line == "0.3333 -2.5e-07");
+  }
+
+  SUBCASE("Text rows of interleaved columns") {
+    std::vector<double> const pairs{1.5, -2., 0.25, 3.};
+    std::span<const double> const columns[]{
+        pairs, std::span<const double>{pairs}.subspan(1)};
+    std::string text = "#\n";
+    tb::formatRows(text, columns, 0, 2, {}, 2);
+    CHECK(text == "#\n1.5 -2\n0.25 3\n");
+  }
+
+  SUBCASE("NumPy arrays") {
+    tb::EnsembleConfig config{1000, 5., 0.01, 0.785, 0.001, 9, 0, true};
+    auto result = tb::runMultipleSimulations(config, border.get());
+    auto const rows = result.finalY.values().size();
+
+    auto readAll = [&] {
+      std::ifstream in{path, std::ios::binary};
+      return std::string{std::istreambuf_iterator<char>{in}, {}};
+    };
+
+    SUBCASE("A single column") {
+      tb::writeNpy(path, std::span{result.finalY.values()});
+      auto const bytes = readAll();
+      REQUIRE(bytes.size() > 10);
+      CHECK(bytes.substr(0, 8) == std::string{"\x93NUMPY\x01\0", 8});
+      std::size_t const headerLength =
+          static_cast<unsigned char>(bytes[8]) +
+          256u * static_cast<unsigned char>(bytes[9]);
+      auto const dataStart = 10 + headerLength;
+      CHECK(dataStart % 64 == 0);
+      auto const header = bytes.substr(10, headerLength);
+      CHECK(header.find("'descr': '<f8'") != std::string::npos);
+      CHECK(header.find("'shape': (" + std::to_string(rows) + ",)") !=
+            std::string::npos);
+      REQUIRE(bytes.size() == dataStart + rows * sizeof(double));
+      CHECK(std::memcmp(bytes.data() + dataStart, result.finalY.values().data(),
+                        rows * sizeof(double)) == 0);
+    }
+
+    SUBCASE("A structured array") {
+      tb::writeNpyRecords(path, result);
+      auto const bytes = readAll();
+      auto const dataStart = bytes.size() - rows * 4 * sizeof(double);
+      CHECK(bytes.find("('Theta0', '<f8')") < dataStart);
+      double record[4];
+      std::memcpy(record, bytes.data() + dataStart + 5 * sizeof(record),
+                  sizeof(record));
+      CHECK(record[0] == result.finalY.values()[5]);
+      CHECK(record[1] == result.finalTheta.values()[5]);
+      CHECK(record[2] == result.initialY.values()[5]);
+      CHECK(record[3] == result.initialTheta.values()[5]);
+    }
+
+    SUBCASE("An npz archive") {
+      tb::writeNpz(path, result);
+      auto const bytes = readAll();
+      CHECK(bytes.substr(0, 4) == "PK\x03\x04");
+      CHECK(bytes.find("Thetaf.npy") != std::string::npos);
+      CHECK(bytes.find("Theta0.npy") != std::string::npos);
+      CHECK(bytes.substr(bytes.size() - 22, 4) == "PK\x05\x06");
+    }
+  }
+
+  SUBCASE("Reading a file that is not a results file throws") {
+    {
+      std::ofstream out{path};
+      out << "0.5 0.1\n";
+    }
+    CHECK_THROWS(tb::ResultsFile{path});
+    CHECK_THROWS(tb::ResultsFile{path + ".missing"});
+  }
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,157 @@
+#include "script.hpp"
+
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "results.hpp"
+#include "threadpool.hpp"
+
+namespace tb {
+
+namespace {
+
+std::string extension(const std::string& kind) {
+  return kind.empty() ? ".tbr" : "." + kind;
+}
+
+}  // namespace
+
+std::vector<Job> parseScript(std::istream& is, const std::string& prefix) {
+  std::vector<Job> jobs;
+  bool bordersSet = false;
+  double r1 = 0.;
+  double r2 = 0.;
+  double l = 0.;
+  bool seedSet = false;
+  std::uint64_t seed = 0;
+  std::size_t reservoir = 0;
+  bool keepInitial = false;
+  std::string mapDirectory = "-";
+  std::random_device random;
+
+  std::string line;
+  for (int number = 1; std::getline(is, line); ++number) {
+    auto fail = [&](const std::string& what) {
+      return std::runtime_error("Line " + std::to_string(number) + ": " +
+                                what);
+    };
+
+    std::istringstream args{line.substr(0, line.find('#'))};
+    char cmd{};
+    if (!(args >> cmd)) continue;
+
+    bool valid = true;
+    if (cmd == 'b') {
+      valid = static_cast<bool>(args >> r1 >> r2 >> l);
+      if (valid && (r1 < 0.0 || r2 < 0.0 || l < 0.0)) {
+        throw fail("Invalid border value(s)");
+      }
+      bordersSet = valid;
+
+    } else if (cmd == 'g') {
+      EnsembleConfig config{};
+      if (!(args >> config.N >> config.Y0_mean >> config.Y0_err >>
+            config.Theta0_mean >> config.Theta0_err)) {
+        throw fail("Invalid arguments for command g");
+      }
+      if (!bordersSet) throw fail("Set borders before running command g");
+      if (config.N <= 0) throw fail("Invalid number of particles");
+
+      config.seed = seedSet ? seed : random();
+      config.reservoir = reservoir;
+      config.keepInitial = keepInitial;
+      if (mapDirectory != "-") config.mapDirectory = mapDirectory;
+      seedSet = false;
+      jobs.push_back({prefix + "." + std::to_string(jobs.size() + 1), r1, r2,
+                      l, config});
+
+    } else if (cmd == 'o') {
+      if (jobs.empty()) throw fail("Generate data before running command o");
+      JobOutput output;
+      args >> output.kind >> output.precision;
+      if (!output.kind.empty() && output.kind != "csv" &&
+          output.kind != "tsv" && output.kind != "txt" &&
+          output.kind != "npy" && output.kind != "npz") {
+        throw fail("Unknown output format " + output.kind);
+      }
+      jobs.back().outputs.push_back(output);
+
+    } else if (cmd == 's') {
+      valid = seedSet = static_cast<bool>(args >> seed);
+    } else if (cmd == 'r') {
+      valid = static_cast<bool>(args >> reservoir);
+    } else if (cmd == 'i') {
+      valid = static_cast<bool>(args >> keepInitial);
+    } else if (cmd == 'm') {
+      valid = static_cast<bool>(args >> mapDirectory);
+    } else if (cmd == 'q') {
+      break;
+    } else {
+      throw fail(std::string{"Command not available in scripts: "} + cmd);
+    }
+
+    if (!valid) {
+      throw fail(std::string{"Invalid arguments for command "} + cmd);
+    }
+  }
+
+  return jobs;
+}
+
+MultipleResult runJob(const Job& job) {
+  auto const border = createBorder(job.r1, job.r2, job.l);
+  auto result = runMultipleSimulations(job.config, border.get());
+
+  for (auto const& output : job.outputs) {
+    auto const path = job.name + extension(output.kind);
+    if (output.kind.empty()) {
+      writeResults(path, *border, job.config, result);
+    } else if (output.kind == "npy") {
+      writeNpyRecords(path, result);
+    } else if (output.kind == "npz") {
+      writeNpz(path, result);
+    } else {
+      auto format = output.kind == "csv"   ? csvFormat
+                    : output.kind == "tsv" ? tsvFormat
+                                           : TextFormat{};
+      format.precision = output.precision;
+      // the other jobs already keep the threads busy
+      writeText(path, result, format, 1);
+    }
+  }
+  return result;
+}
+
+std::vector<JobSummary> runJobs(const std::vector<Job>& jobs,
+                                unsigned threads) {
+  std::vector<JobSummary> summaries(jobs.size());
+  ThreadPool pool{threads};
+
+  for (std::size_t j = 0; j != jobs.size(); ++j) {
+    pool.submit([&jobs, &summaries, j] {
+      auto& summary = summaries[j];
+      summary.name = jobs[j].name;
+      summary.seed = jobs[j].config.seed;
+      try {
+        auto const result = runJob(jobs[j]);
+        summary.accepted = result.accepted;
+        summary.rejected = result.rejected;
+        if (result.accepted < 4) {
+          throw std::runtime_error(
+              "Not enough particles reach final conditions to run "
+              "statistics");
+        }
+        summary.finalY = result.finalY.statistics();
+        summary.finalTheta = result.finalTheta.statistics();
+      } catch (const std::exception& e) {
+        summary.error = e.what();
+      }
+    });
+  }
+  pool.wait();
+
+  return summaries;
+}
+
+}  // namespace tb
@@ -0,0 +1,61 @@
+#ifndef SCRIPT_HPP
+#define SCRIPT_HPP
+
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief File written at the end of a job: a binary results file (empty
+/// kind), a text file (csv, tsv or txt, with an optional precision) or NumPy
+/// arrays (npy or npz).
+struct JobOutput {
+  std::string kind{};
+  int precision = -1;
+};
+
+/// @brief One Monte Carlo run of a script, with its own geometry, ensemble
+/// and outputs. The outputs are named after the job, e.g. name.csv.
+struct Job {
+  std::string name;
+  double r1;
+  double r2;
+  double l;
+  EnsembleConfig config;
+  std::vector<JobOutput> outputs{};
+};
+
+/// @brief Outcome of a job; error is empty if the job succeeded.
+struct JobSummary {
+  std::string name;
+  std::uint64_t seed;
+  int accepted;
+  int rejected;
+  Statistics finalY;
+  Statistics finalTheta;
+  std::string error{};
+};
+
+/// @brief Reads a script of the commands of the interactive mode, one per
+/// line, with # starting a comment. Every g becomes a job using the border
+/// and the options (s, r, i, m) set before it; the o commands that follow it
+/// add outputs to that job. As in the interactive mode, a seed set with s
+/// applies to the next g only, the others get a random one. Jobs are named
+/// prefix.1, prefix.2, ... in order.
+std::vector<Job> parseScript(std::istream& is, const std::string& prefix);
+
+/// @brief Runs the job and writes its outputs.
+MultipleResult runJob(const Job& job);
+
+/// @brief Runs the jobs concurrently on a pool of the given number of
+/// threads. A failing job does not stop the others; the summaries are in the
+/// order of the jobs.
+std::vector<JobSummary> runJobs(const std::vector<Job>& jobs,
+                                unsigned threads);
+
+}  // namespace tb
+
+#endif
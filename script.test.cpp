@@ -0,0 +1,126 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <atomic>
+#include <filesystem>
+#include <sstream>
+
+#include "doctest.h"
+#include "results.hpp"
+#include "script.hpp"
+#include "threadpool.hpp"
+
+TEST_CASE("Testing the thread pool") {
+  tb::ThreadPool pool{4};
+  CHECK(pool.size() == 4);
+
+  SUBCASE("Every task is run") {
+    std::atomic<int> sum{0};
+    for (int i = 1; i <= 100; ++i) pool.submit([&sum, i] { sum += i; });
+    pool.wait();
+    CHECK(sum == 5050);
+  }
+
+  SUBCASE("An exception is rethrown by wait, after the other tasks") {
+    std::atomic<int> count{0};
+    pool.submit([] { throw std::runtime_error("Task failed"); });
+    for (int i = 0; i != 10; ++i) pool.submit([&count] { ++count; });
+    CHECK_THROWS_WITH(pool.wait(), "Task failed");
+    CHECK(count == 10);
+    pool.wait();
+  }
+}
+
+TEST_CASE("Testing scripts") {
+  auto const prefix =
+      (std::filesystem::temp_directory_path() / "tb_script").string();
+
+  SUBCASE("Parsing jobs and their options") {
+    std::istringstream script{
+        "# two geometries\n"
+        "b 20 15 50\n"
+        "s 42\n"
+        "r 100\n"
+        "g 1000 5 0.01 0.785 0.001\n"
+        "o csv 6  # text output\n"
+        "o\n"
+        "\n"
+        "b 10 12 30\n"
+        "i 1\n"
+        "g 2000 0 1 0 0.1\n"
+        "q\n"
+        "g 3000 0 1 0 0.1\n"};
+    auto const jobs = tb::parseScript(script, "run");
+    REQUIRE(jobs.size() == 2);
+
+    CHECK(jobs[0].name == "run.1");
+    CHECK(jobs[0].r1 == 20.);
+    CHECK(jobs[0].config.N == 1000);
+    CHECK(jobs[0].config.seed == 42);
+    CHECK(jobs[0].config.reservoir == 100);
+    CHECK(!jobs[0].config.keepInitial);
+    REQUIRE(jobs[0].outputs.size() == 2);
+    CHECK(jobs[0].outputs[0].kind == "csv");
+    CHECK(jobs[0].outputs[0].precision == 6);
+    CHECK(jobs[0].outputs[1].kind.empty());
+
+    CHECK(jobs[1].name == "run.2");
+    CHECK(jobs[1].l == 30.);
+    CHECK(jobs[1].config.Theta0_err == 0.1);
+    CHECK(jobs[1].config.reservoir == 100);
+    CHECK(jobs[1].config.keepInitial);
+    CHECK(jobs[1].outputs.empty());
+  }
+
+  SUBCASE("Errors report the line") {
+    auto parse = [](const std::string& text) {
+      std::istringstream script{text};
+      return tb::parseScript(script, "run");
+    };
+    CHECK_THROWS_WITH(parse("g 1000 5 0.01 0.785 0.001\n"),
+                      "Line 1: Set borders before running command g");
+    CHECK_THROWS_WITH(parse("b 20 15 50\no\n"),
+                      "Line 2: Generate data before running command o");
+    CHECK_THROWS_WITH(parse("b 20 15 50\n\nv 0 0\n"),
+                      "Line 3: Command not available in scripts: v");
+    CHECK_THROWS_WITH(parse("b 20 15\n"),
+                      "Line 1: Invalid arguments for command b");
+    CHECK_THROWS_WITH(parse("b 20 15 50\ng 10 0 1 0 0.1\no xls\n"),
+                      "Line 3: Unknown output format xls");
+  }
+
+  SUBCASE("Jobs run concurrently as they would alone") {
+    std::istringstream script{
+        "b 20 15 50\n"
+        "s 1\n"
+        "g 20000 5 0.01 0.785 0.001\n"
+        "o\n"
+        "s 2\n"
+        "g 20000 0 5 0.3 0.1\n"
+        "o npz\n"
+        "b 20 2 20\n"
+        "s 3\n"
+        "g 1000 30 0.01 0 0.001\n"};
+    auto const jobs = tb::parseScript(script, prefix);
+    REQUIRE(jobs.size() == 3);
+    auto const summaries = tb::runJobs(jobs, 3);
+    REQUIRE(summaries.size() == 3);
+
+    for (std::size_t j = 0; j != 2; ++j) {
+      auto border = tb::createBorder(jobs[j].r1, jobs[j].r2, jobs[j].l);
+      auto const alone = tb::runMultipleSimulations(jobs[j].config,
+                                                    border.get());
+      CHECK(summaries[j].name == jobs[j].name);
+      CHECK(summaries[j].error.empty());
+      CHECK(summaries[j].accepted == alone.accepted);
+      CHECK(summaries[j].finalY.mean == alone.finalY.statistics().mean);
+    }
+    CHECK(summaries[2].accepted == 0);
+    CHECK(!summaries[2].error.empty());
+
+    tb::ResultsFile file{prefix + ".1.tbr"};
+    CHECK(file.header().seed == 1);
+    CHECK(std::filesystem::exists(prefix + ".2.npz"));
+    std::filesystem::remove(prefix + ".1.tbr");
+    std::filesystem::remove(prefix + ".2.npz");
+  }
+}
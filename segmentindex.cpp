@@ -0,0 +1,88 @@
+#include "segmentindex.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace tb {
+
+SegmentIndex::SegmentIndex(LodPoint min, LodPoint max, unsigned columns,
+                           unsigned rows)
+    : min_{min},
+      cellWidth_{(max.x - min.x) / columns},
+      cellHeight_{(max.y - min.y) / rows},
+      columns_{columns},
+      rows_{rows},
+      cells_(std::size_t{columns} * rows) {
+  if (columns == 0 || rows == 0 || !(max.x > min.x) || !(max.y > min.y)) {
+    throw std::invalid_argument("Invalid segment index");
+  }
+}
+
+SegmentIndex::CellRange SegmentIndex::cells(LodPoint a, LodPoint b) const {
+  auto const cell = [](double t, double size, unsigned n) {
+    auto const last = static_cast<double>(n - 1);
+    return static_cast<std::size_t>(std::clamp(t / size, 0., last));
+  };
+  return {cell(std::min(a.x, b.x) - min_.x, cellWidth_, columns_),
+          cell(std::max(a.x, b.x) - min_.x, cellWidth_, columns_),
+          cell(std::min(a.y, b.y) - min_.y, cellHeight_, rows_),
+          cell(std::max(a.y, b.y) - min_.y, cellHeight_, rows_)};
+}
+
+std::pair<LodPoint, LodPoint> SegmentIndex::clip(LodPoint a, LodPoint b,
+                                                 std::size_t row) const {
+  if (a.y == b.y) return {a, b};
+  // the rows on the edge extend beyond the rectangle
+  auto const infinity = std::numeric_limits<double>::infinity();
+  auto const y = [&](std::size_t r) {
+    return min_.y + static_cast<double>(r) * cellHeight_;
+  };
+  auto const low = row == 0 ? -infinity : y(row);
+  auto const high = row + 1 == rows_ ? infinity : y(row + 1);
+  auto const at = [&](double t) {
+    t = std::clamp(t, 0., 1.);
+    return LodPoint{a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)};
+  };
+  return {at((low - a.y) / (b.y - a.y)), at((high - a.y) / (b.y - a.y))};
+}
+
+void SegmentIndex::add(LodPoint a, LodPoint b) {
+  auto const range = cells(a, b);
+  // the columns crossed within each row, widened by a small fraction of a
+  // cell so that rounding misses no cell at a corner
+  auto const margin = 1e-9 * cellWidth_;
+  for (auto row = range.firstRow; row <= range.lastRow; ++row) {
+    auto const [p, q] = clip(a, b, row);
+    auto const columns = cells({std::min(p.x, q.x) - margin, p.y},
+                               {std::max(p.x, q.x) + margin, q.y});
+    for (auto column = columns.firstColumn; column <= columns.lastColumn;
+         ++column) {
+      cells_[row * columns_ + column].push_back(size_);
+    }
+  }
+  ++size_;
+}
+
+void SegmentIndex::clear() {
+  for (auto& cell : cells_) cell.clear();
+  size_ = 0;
+}
+
+void SegmentIndex::query(LodPoint min, LodPoint max,
+                         std::vector<std::uint32_t>& out) const {
+  out.clear();
+  auto const range = cells(min, max);
+  for (auto row = range.firstRow; row <= range.lastRow; ++row) {
+    for (auto column = range.firstColumn; column <= range.lastColumn;
+         ++column) {
+      auto const& cell = cells_[row * columns_ + column];
+      out.insert(out.end(), cell.begin(), cell.end());
+    }
+  }
+  // a segment is listed in every cell it crosses
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+}  // namespace tb
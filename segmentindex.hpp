@@ -0,0 +1,54 @@
+#ifndef SEGMENTINDEX_HPP
+#define SEGMENTINDEX_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "lod.hpp"
+
+namespace tb {
+
+/// @brief Uniform grid over a rectangle listing, for each cell, the segments
+/// that cross it, so that the segments in a small part of the rectangle are
+/// found without looking at the others. A segment is listed in about
+/// columns + rows cells at most, not in every cell of its bounding box.
+/// Segments are numbered in the order they are added; parts outside the
+/// rectangle count as being in the cells on its edge.
+class SegmentIndex {
+  LodPoint min_;
+  double cellWidth_;
+  double cellHeight_;
+  unsigned columns_;
+  unsigned rows_;
+  std::vector<std::vector<std::uint32_t>> cells_;
+  std::uint32_t size_{0};
+
+  struct CellRange {
+    std::size_t firstColumn, lastColumn, firstRow, lastRow;
+  };
+  CellRange cells(LodPoint a, LodPoint b) const;
+
+  /// @brief The part of the segment from a to b within the given row.
+  std::pair<LodPoint, LodPoint> clip(LodPoint a, LodPoint b,
+                                     std::size_t row) const;
+
+ public:
+  SegmentIndex(LodPoint min, LodPoint max, unsigned columns, unsigned rows);
+
+  /// @brief Adds the segment from a to b, numbered size().
+  void add(LodPoint a, LodPoint b);
+
+  std::uint32_t size() const { return size_; }
+
+  void clear();
+
+  /// @brief Replaces the content of out with the numbers of the segments
+  /// that may cross the rectangle, each once and in increasing order.
+  void query(LodPoint min, LodPoint max,
+             std::vector<std::uint32_t>& out) const;
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,116 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include "segmentindex.hpp"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "doctest.h"
+
+namespace {
+
+/// @brief Whether the segment from a to b has a point in the rectangle
+/// (Liang-Barsky clipping).
+bool crosses(tb::LodPoint a, tb::LodPoint b, tb::LodPoint min,
+             tb::LodPoint max) {
+  double t0 = 0.;
+  double t1 = 1.;
+  auto const clip = [&](double p, double q) {
+    if (p == 0.) return q >= 0.;
+    auto const t = q / p;
+    if (p < 0.) {
+      t0 = std::max(t0, t);
+    } else {
+      t1 = std::min(t1, t);
+    }
+    return t0 <= t1;
+  };
+  auto const dx = b.x - a.x;
+  auto const dy = b.y - a.y;
+  return clip(-dx, a.x - min.x) && clip(dx, max.x - a.x) &&
+         clip(-dy, a.y - min.y) && clip(dy, max.y - a.y);
+}
+
+}  // namespace
+
+TEST_CASE("Testing SegmentIndex") {
+  tb::SegmentIndex index{{0., -1.}, {10., 1.}, 20, 4};
+
+  SUBCASE("Segments are found in the cells they cross") {
+    index.add({0.1, 0.1}, {0.2, 0.2});
+    index.add({9.5, -0.9}, {9.8, -0.5});
+    index.add({0., 0.}, {10., 0.});
+    CHECK(index.size() == 3);
+
+    std::vector<std::uint32_t> found;
+    index.query({0., 0.}, {0.4, 0.4}, found);
+    CHECK(found == std::vector<std::uint32_t>{0, 2});
+    index.query({9., -1.}, {10., -0.6}, found);
+    CHECK(found == std::vector<std::uint32_t>{1});
+    index.query({9., -1.}, {10., 0.}, found);
+    CHECK(found == std::vector<std::uint32_t>{1, 2});
+    index.query({4., 0.6}, {5., 0.9}, found);
+    CHECK(found.empty());
+    // parts outside the rectangle are in the cells on its edge
+    index.query({-5., -5.}, {0.1, 5.}, found);
+    CHECK(found == std::vector<std::uint32_t>{0, 2});
+
+    index.clear();
+    CHECK(index.size() == 0);
+    index.query({0., -1.}, {10., 1.}, found);
+    CHECK(found.empty());
+  }
+
+  SUBCASE("Segments are only in the cells they cross") {
+    // the diagonal crosses about columns + rows cells of its bounding box,
+    // the whole grid
+    index.add({0., -1.}, {10., 1.});
+    std::vector<std::uint32_t> found;
+    index.query({8., -1.}, {9., -0.6}, found);
+    CHECK(found.empty());
+    index.query({0.1, -1.}, {0.4, -0.9}, found);
+    CHECK(found == std::vector<std::uint32_t>{0});
+    index.query({7., 0.3}, {7.2, 0.5}, found);
+    CHECK(found == std::vector<std::uint32_t>{0});
+  }
+
+  SUBCASE("No segment crossing the rectangle is missed") {
+    std::mt19937 engine{7};
+    std::uniform_real_distribution<double> x{0., 10.};
+    std::uniform_real_distribution<double> y{-1., 1.};
+    std::vector<tb::LodPoint> points;
+    points.push_back({x(engine), y(engine)});
+    for (int i = 0; i != 500; ++i) {
+      // short segments, as in a trajectory near the vertex, and a few long
+      // ones across the rectangle
+      auto const& p = points.back();
+      if (i % 20 == 0) {
+        points.push_back({x(engine), y(engine)});
+      } else {
+        points.push_back({std::clamp(p.x + 0.1 * y(engine), 0., 10.),
+                          std::clamp(p.y + 0.1 * y(engine), -1., 1.)});
+      }
+      index.add(points[points.size() - 2], points.back());
+    }
+
+    tb::LodPoint const min{3., -0.5};
+    tb::LodPoint const max{4.5, 0.25};
+    std::vector<std::uint32_t> found;
+    index.query(min, max, found);
+    CHECK(found.size() < points.size() / 2);
+    for (std::size_t i = 0; i + 1 != points.size(); ++i) {
+      if (crosses(points[i], points[i + 1], min, max)) {
+        CHECK(std::binary_search(found.begin(), found.end(), i));
+      }
+    }
+  }
+
+  SUBCASE("Invalid shape") {
+    CHECK_THROWS_AS((tb::SegmentIndex{{0., 0.}, {1., 1.}, 0, 4}),
+                    std::invalid_argument);
+    CHECK_THROWS_AS((tb::SegmentIndex{{0., 0.}, {0., 1.}, 4, 4}),
+                    std::invalid_argument);
+  }
+}
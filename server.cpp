@@ -0,0 +1,341 @@
+#include "server.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "query.hpp"
+
+namespace tb {
+
+namespace {
+
+sockaddr_un socketAddress(const std::string& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error{"Invalid socket path " + path};
+  }
+  std::memcpy(address.sun_path, path.data(), path.size());
+  return address;
+}
+
+/// @brief Reads exactly the given number of bytes; false if the connection
+/// is closed first.
+bool readAll(int fd, void* data, std::size_t bytes) {
+  auto p = static_cast<char*>(data);
+  while (bytes > 0) {
+    auto const n = ::recv(fd, p, bytes, 0);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    bytes -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void* data, std::size_t bytes) {
+  auto p = static_cast<const char*>(data);
+  while (bytes > 0) {
+    // a client going away must not kill the server with SIGPIPE
+    auto const n = ::send(fd, p, bytes, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    bytes -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+bool writeError(int fd, QueryHeader reply, const std::string& message) {
+  reply.kind = static_cast<std::uint32_t>(QueryStatus::Error);
+  reply.count = message.size();
+  return writeAll(fd, &reply, sizeof(reply)) &&
+         writeAll(fd, message.data(), message.size());
+}
+
+}  // namespace
+
+QueryServer::QueryServer(const std::string& path, unsigned threads)
+    : path_{path}, pool_{threads} {
+  auto const address = socketAddress(path);
+  listener_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener_ == -1) {
+    throw std::runtime_error{"Impossible to create a socket"};
+  }
+
+  // only a socket left by a previous server is replaced, never a file
+  struct stat info {};
+  if (::stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+    ::unlink(path.c_str());
+  }
+  if (::bind(listener_, reinterpret_cast<const sockaddr*>(&address),
+             sizeof(address)) == -1 ||
+      ::listen(listener_, SOMAXCONN) == -1) {
+    ::close(listener_);
+    throw std::runtime_error{"Impossible to listen on " + path};
+  }
+
+  acceptor_ = std::thread{&QueryServer::acceptLoop, this};
+  dispatcher_ = std::thread{&QueryServer::dispatchLoop, this};
+}
+
+QueryServer::~QueryServer() { stop(); }
+
+std::uint32_t QueryServer::addBorder(double r1, double r2, double l) {
+  if (!(r1 >= 0. && r2 >= 0. && l > 0.) || !std::isfinite(r1) ||
+      !std::isfinite(r2) || !std::isfinite(l)) {
+    throw std::runtime_error{"Invalid border value(s)"};
+  }
+  std::lock_guard lock{mutex_};
+  if (borders_.size() == std::numeric_limits<std::uint16_t>::max()) {
+    throw std::runtime_error{"Too many borders"};
+  }
+  borders_.push_back(createBorder(r1, r2, l));
+  return static_cast<std::uint32_t>(borders_.size() - 1);
+}
+
+const Border* QueryServer::border(std::uint32_t id) {
+  std::lock_guard lock{mutex_};
+  return id < borders_.size() ? borders_[id].get() : nullptr;
+}
+
+void QueryServer::acceptLoop() {
+  while (true) {
+    auto const fd = ::accept4(listener_, nullptr, nullptr, SOCK_CLOEXEC);
+    auto const error = errno;
+
+    std::lock_guard lock{mutex_};
+    if (stopping_) {
+      if (fd != -1) ::close(fd);
+      return;
+    }
+    if (fd == -1) {
+      // e.g. out of file descriptors: retry later instead of spinning
+      if (error != EINTR && error != ECONNABORTED) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+      }
+      continue;
+    }
+
+    // the threads of closed connections are joined here; their descriptors
+    // are closed only now, so stop() never shuts down a reused one
+    for (auto it = connections_.begin(); it != connections_.end();) {
+      if (it->finished) {
+        it->thread.join();
+        ::close(it->fd);
+        it = connections_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    auto& connection = connections_.emplace_back(fd);
+    connection.thread = std::thread{[this, &connection] {
+      serve(connection);
+      connection.finished = true;
+    }};
+  }
+}
+
+void QueryServer::serve(Connection& connection) {
+  auto const fd = connection.fd;
+  std::vector<double> initial;
+  std::vector<double> final;
+
+  QueryHeader header{};
+  while (readAll(fd, &header, sizeof(header))) {
+    QueryHeader reply{static_cast<std::uint32_t>(QueryStatus::Ok),
+                      header.border, 0};
+
+    if (header.kind == static_cast<std::uint32_t>(QueryRequest::AddBorder)) {
+      double geometry[3];
+      if (!readAll(fd, geometry, sizeof(geometry))) return;
+      try {
+        reply.border = addBorder(geometry[0], geometry[1], geometry[2]);
+      } catch (const std::exception& e) {
+        if (!writeError(fd, reply, e.what())) return;
+        continue;
+      }
+      if (!writeAll(fd, &reply, sizeof(reply))) return;
+
+    } else if (header.kind ==
+                   static_cast<std::uint32_t>(QueryRequest::FinalStates) &&
+               header.count <= maxQueryCount) {
+      initial.resize(2 * header.count);
+      if (!readAll(fd, initial.data(), initial.size() * sizeof(double))) {
+        return;
+      }
+      auto const geometry = border(header.border);
+      if (geometry == nullptr) {
+        if (!writeError(fd, reply, "Unknown border")) return;
+        continue;
+      }
+
+      final.resize(initial.size());
+      Pending pending{geometry, initial, final};
+      {
+        std::unique_lock lock{mutex_};
+        queue_.push_back(&pending);
+        queued_.notify_one();
+        done_.wait(lock, [&pending] { return pending.done; });
+      }
+
+      reply.count = header.count;
+      if (!writeAll(fd, &reply, sizeof(reply)) ||
+          !writeAll(fd, final.data(), final.size() * sizeof(double))) {
+        return;
+      }
+
+    } else {
+      // the payload size is unknown, so the stream cannot be followed further
+      writeError(fd, reply, "Invalid request");
+      return;
+    }
+  }
+}
+
+void QueryServer::dispatchLoop() {
+  std::vector<double> initial;
+  std::vector<double> final;
+
+  std::unique_lock lock{mutex_};
+  while (true) {
+    queued_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) return;
+    auto batch = std::exchange(queue_, {});
+    lock.unlock();
+
+    // the requests for the same geometry are evaluated as a single batch
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const Pending* a, const Pending* b) {
+                       return a->border < b->border;
+                     });
+    for (auto first = batch.begin(); first != batch.end();) {
+      auto const geometry = (*first)->border;
+      auto const last = std::find_if(first, batch.end(), [=](Pending* p) {
+        return p->border != geometry;
+      });
+
+      initial.clear();
+      for (auto it = first; it != last; ++it) {
+        initial.insert(initial.end(), (*it)->initial.begin(),
+                       (*it)->initial.end());
+      }
+      final.resize(initial.size());
+      try {
+        computeFinalStates(initial, final, *geometry, pool_);
+      } catch (const std::exception&) {
+        std::fill(final.begin(), final.end(),
+                  std::numeric_limits<double>::quiet_NaN());
+      }
+      auto source = final.begin();
+      for (auto it = first; it != last; ++it) {
+        auto const n = static_cast<std::ptrdiff_t>((*it)->final.size());
+        std::copy(source, source + n, (*it)->final.begin());
+        source += n;
+      }
+      first = last;
+    }
+
+    lock.lock();
+    for (auto pending : batch) pending->done = true;
+    done_.notify_all();
+  }
+}
+
+void QueryServer::stop() {
+  {
+    std::lock_guard lock{mutex_};
+    if (stopping_) return;
+    stopping_ = true;
+  }
+  ::shutdown(listener_, SHUT_RDWR);
+  acceptor_.join();
+
+  // the acceptor is gone, so the connections are no longer shared; pending
+  // requests are still answered by the dispatcher
+  for (auto& connection : connections_) {
+    ::shutdown(connection.fd, SHUT_RDWR);
+  }
+  for (auto& connection : connections_) {
+    connection.thread.join();
+    ::close(connection.fd);
+  }
+  connections_.clear();
+
+  {
+    std::lock_guard lock{mutex_};
+    closed_ = true;
+  }
+  queued_.notify_all();
+  dispatcher_.join();
+
+  ::close(listener_);
+  ::unlink(path_.c_str());
+}
+
+QueryClient::QueryClient(const std::string& path) {
+  auto const address = socketAddress(path);
+  fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ == -1 || ::connect(fd_, reinterpret_cast<const sockaddr*>(&address),
+                             sizeof(address)) == -1) {
+    if (fd_ != -1) ::close(fd_);
+    throw std::runtime_error{"Impossible to connect to " + path};
+  }
+}
+
+QueryClient::~QueryClient() { ::close(fd_); }
+
+QueryHeader QueryClient::request(QueryHeader header, const void* payload,
+                                 std::size_t bytes, void* reply,
+                                 std::size_t replyBytes) {
+  if (!writeAll(fd_, &header, sizeof(header)) ||
+      !writeAll(fd_, payload, bytes) ||
+      !readAll(fd_, &header, sizeof(header))) {
+    throw std::runtime_error{"Connection to the server lost"};
+  }
+  if (header.kind != static_cast<std::uint32_t>(QueryStatus::Ok)) {
+    std::string message(std::min<std::uint64_t>(header.count, 1 << 12), '\0');
+    readAll(fd_, message.data(), message.size());
+    throw std::runtime_error{message};
+  }
+  if (!readAll(fd_, reply, replyBytes)) {
+    throw std::runtime_error{"Connection to the server lost"};
+  }
+  return header;
+}
+
+std::uint32_t QueryClient::addBorder(double r1, double r2, double l) {
+  double const geometry[3]{r1, r2, l};
+  auto const reply = request(
+      {static_cast<std::uint32_t>(QueryRequest::AddBorder), 0, 0}, geometry,
+      sizeof(geometry), nullptr, 0);
+  return reply.border;
+}
+
+std::vector<double> QueryClient::finalStates(std::uint32_t border,
+                                             std::span<const double> initial) {
+  assert(initial.size() % 2 == 0);
+  if (initial.size() / 2 > maxQueryCount) {
+    throw std::runtime_error{"Too many initial conditions in one request"};
+  }
+  std::vector<double> final(initial.size());
+  request({static_cast<std::uint32_t>(QueryRequest::FinalStates), border,
+           initial.size() / 2},
+          initial.data(), initial.size_bytes(), final.data(),
+          final.size() * sizeof(double));
+  return final;
+}
+
+}  // namespace tb
@@ -0,0 +1,125 @@
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "threadpool.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief Requests of the query protocol. Every message, in either
+/// direction, is a 16-byte header in native byte order followed by its
+/// payload:
+/// - AddBorder: r1, r2 and l as 3 doubles; the reply has the id of the new
+///   geometry in the border field.
+/// - FinalStates: count pairs of doubles (Y0, Theta0) for the given border;
+///   the reply has count pairs (Y, Theta), NaN where the particle cannot be
+///   simulated.
+/// A failed request gets a reply with status Error and an error message of
+/// count bytes.
+enum class QueryRequest : std::uint32_t { AddBorder = 1, FinalStates = 2 };
+enum class QueryStatus : std::uint32_t { Ok = 0, Error = 1 };
+
+struct QueryHeader {
+  std::uint32_t kind;
+  std::uint32_t border;
+  std::uint64_t count;
+};
+
+/// @brief Largest number of conditions in a single request.
+inline constexpr std::uint64_t maxQueryCount = 1 << 22;
+
+/// @brief Daemon answering final-state queries on a Unix domain socket.
+/// Each client connection is served by its own thread; the requests pending
+/// at any time, from all the clients, are evaluated together in batches on
+/// a shared thread pool, one batch per geometry.
+class QueryServer {
+  struct Pending {
+    const Border* border;
+    std::span<const double> initial;
+    std::span<double> final;
+    bool done{false};
+  };
+
+  struct Connection {
+    int fd;
+    std::thread thread{};
+    std::atomic<bool> finished{false};
+  };
+
+  std::string path_;
+  int listener_{-1};
+  ThreadPool pool_;
+
+  std::mutex mutex_{};
+  std::condition_variable queued_{};
+  std::condition_variable done_{};
+  std::vector<Pending*> queue_{};
+  std::deque<std::unique_ptr<Border>> borders_{};
+  std::list<Connection> connections_{};
+  bool stopping_{false};
+  bool closed_{false};
+
+  std::thread acceptor_{};
+  std::thread dispatcher_{};
+
+  void acceptLoop();
+  void dispatchLoop();
+  void serve(Connection& connection);
+  const Border* border(std::uint32_t id);
+
+ public:
+  /// @brief Listens on a socket at the path, replacing a stale one, and
+  /// starts serving at once.
+  explicit QueryServer(const std::string& path, unsigned threads);
+
+  /// @brief Stops the server.
+  ~QueryServer();
+
+  QueryServer(const QueryServer&) = delete;
+  QueryServer& operator=(const QueryServer&) = delete;
+
+  /// @brief Loads a geometry and returns its id; clients can also add
+  /// geometries.
+  std::uint32_t addBorder(double r1, double r2, double l);
+
+  /// @brief Closes every connection, after the requests being evaluated,
+  /// and removes the socket.
+  void stop();
+};
+
+/// @brief Connection to a QueryServer.
+class QueryClient {
+  int fd_{-1};
+
+  QueryHeader request(QueryHeader header, const void* payload,
+                      std::size_t bytes, void* reply, std::size_t replyBytes);
+
+ public:
+  explicit QueryClient(const std::string& path);
+  ~QueryClient();
+
+  QueryClient(const QueryClient&) = delete;
+  QueryClient& operator=(const QueryClient&) = delete;
+
+  std::uint32_t addBorder(double r1, double r2, double l);
+
+  /// @brief Final (Y, Theta) pairs of the initial (Y0, Theta0) pairs.
+  std::vector<double> finalStates(std::uint32_t border,
+                                  std::span<const double> initial);
+};
+
+}  // namespace tb
+
+#endif
@@ -0,0 +1,114 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "doctest.h"
+#include "query.hpp"
+#include "server.hpp"
+
+TEST_CASE("Testing the query server") {
+  auto const path =
+      (std::filesystem::temp_directory_path() / "tb_server.test.sock")
+          .string();
+  tb::QueryServer server{path, 2};
+  auto const straight = server.addBorder(20., 20., 50.);
+
+  std::mt19937_64 eng{3};
+  std::normal_distribution<double> y{0., 8.};
+  std::normal_distribution<double> theta{0., 0.3};
+  std::vector<double> initial;
+  for (int i = 0; i != 10000; ++i) {
+    initial.push_back(y(eng));
+    initial.push_back(theta(eng));
+  }
+
+  auto expected = [&](double r1, double r2, double l) {
+    tb::ThreadPool pool{1};
+    auto border = tb::createBorder(r1, r2, l);
+    std::vector<double> final(initial.size());
+    tb::computeFinalStates(initial, final, *border, pool);
+    return final;
+  };
+  auto same = [](const std::vector<double>& a, const std::vector<double>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](double x, double z) {
+                        return x == z || (std::isnan(x) && std::isnan(z));
+                      });
+  };
+
+  SUBCASE("A single client") {
+    tb::QueryClient client{path};
+    auto const opened = client.addBorder(20., 25., 50.);
+    CHECK(opened == straight + 1);
+    CHECK(same(client.finalStates(straight, initial), expected(20., 20., 50.)));
+    CHECK(same(client.finalStates(opened, initial), expected(20., 25., 50.)));
+    CHECK(client.finalStates(opened, {}).empty());
+  }
+
+  SUBCASE("Concurrent clients get their own answers") {
+    auto const closed = server.addBorder(20., 10., 50.);
+    auto const reference = expected(20., 10., 50.);
+    std::vector<std::thread> clients;
+    std::vector<int> results(8);
+    for (int c = 0; c != 8; ++c) {
+      clients.emplace_back([&, c] {
+        tb::QueryClient client{path};
+        // different sizes, so that the coalesced batches must be split back
+        auto const n = initial.size() - 2 * static_cast<std::size_t>(c);
+        bool ok = true;
+        for (int r = 0; r != 5; ++r) {
+          auto const final = client.finalStates(
+              closed, std::span<const double>{initial}.first(n));
+          ok = ok && std::equal(final.begin(), final.end(), reference.begin(),
+                                [](double x, double z) {
+                                  return x == z ||
+                                         (std::isnan(x) && std::isnan(z));
+                                });
+        }
+        results[static_cast<std::size_t>(c)] = ok;
+      });
+    }
+    for (auto& client : clients) client.join();
+    for (auto ok : results) CHECK(ok);
+  }
+
+  SUBCASE("Errors are reported to the client") {
+    tb::QueryClient client{path};
+    CHECK_THROWS_WITH(client.finalStates(42, initial), "Unknown border");
+    CHECK_THROWS_WITH(client.addBorder(-1., 2., 3.), "Invalid border value(s)");
+    // the connection is still usable
+    CHECK(client.finalStates(straight, initial).size() == initial.size());
+  }
+
+  SUBCASE("A client going away does not stop the server") {
+    {
+      auto const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+      sockaddr_un address{};
+      address.sun_family = AF_UNIX;
+      path.copy(address.sun_path, path.size());
+      REQUIRE(::connect(fd, reinterpret_cast<const sockaddr*>(&address),
+                        sizeof(address)) == 0);
+      tb::QueryHeader header{2, straight, 100};
+      CHECK(::write(fd, &header, sizeof(header)) == sizeof(header));
+      ::close(fd);
+    }
+    tb::QueryClient client{path};
+    CHECK(client.finalStates(straight, initial).size() == initial.size());
+  }
+
+  SUBCASE("Stopping closes the connections and removes the socket") {
+    tb::QueryClient client{path};
+    server.stop();
+    CHECK(!std::filesystem::exists(path));
+    CHECK_THROWS(client.finalStates(straight, initial));
+    CHECK_THROWS(tb::QueryClient{path});
+  }
+}
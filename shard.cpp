@@ -0,0 +1,279 @@
+#include "shard.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace tb {
+
+namespace {
+
+/// @brief Parameters of the run and blocks of the shard, at the start of a
+/// partial file. Everything before index must match among the shards of a
+/// run.
+struct ShardHeader {
+  char magic[8];
+  std::uint64_t version;
+  std::uint64_t N;
+  double Y0_mean;
+  double Y0_err;
+  double Theta0_mean;
+  double Theta0_err;
+  std::uint64_t seed;
+  std::uint64_t reservoir;
+  std::uint64_t keepInitial;
+  std::uint64_t rawSamples;
+  std::uint64_t block;
+  double r1;
+  double r2;
+  double l;
+  std::uint32_t occupancyWidth;
+  std::uint32_t occupancyHeight;
+  std::uint64_t index;
+  std::uint64_t count;
+  std::uint64_t first;
+  std::uint64_t last;
+};
+static_assert(sizeof(ShardHeader) == 160, "No padding expected");
+
+constexpr std::size_t shardRunBytes = offsetof(ShardHeader, index);
+
+std::vector<Sample*> blockSamples(bool keepInitial, MultipleResult& result) {
+  std::vector<Sample*> samples{&result.finalY, &result.finalTheta};
+  if (keepInitial) {
+    samples.push_back(&result.initialY);
+    samples.push_back(&result.initialTheta);
+  }
+  return samples;
+}
+
+/// @brief Fills the histograms of the shard with its accepted particles, then
+/// forwards them to the sink of the run.
+class HistogramSink : public ParticleSink {
+  Snapshot& summary_;
+  ParticleSink* next_;
+
+ public:
+  HistogramSink(Snapshot& summary, ParticleSink* next)
+      : summary_{summary}, next_{next} {}
+
+  void accept(double Y0, double Theta0, double Yf, double Thetaf) override {
+    recordParticle(summary_, Yf, Thetaf);
+    if (next_ != nullptr) next_->accept(Y0, Theta0, Yf, Thetaf);
+  }
+};
+
+struct ShardFile {
+  std::string path;
+  ShardHeader header;
+  std::ifstream is;
+};
+
+}  // namespace
+
+std::pair<std::uint64_t, std::uint64_t> shardBlocks(int N, ShardSpec spec) {
+  if (spec.count <= 0 || spec.index < 0 || spec.index >= spec.count) {
+    throw std::runtime_error("Invalid shard " + std::to_string(spec.index) +
+                             " of " + std::to_string(spec.count));
+  }
+  auto const blocks = ensembleBlocks(N);
+  auto const index = static_cast<std::uint64_t>(spec.index);
+  auto const count = static_cast<std::uint64_t>(spec.count);
+  return {blocks * index / count, blocks * (index + 1) / count};
+}
+
+MultipleResult runShard(const EnsembleConfig& config, const Border* border,
+                        ShardSpec spec, const std::string& path) {
+  auto const [first, last] = shardBlocks(config.N, spec);
+  ShardHeader const header{{'T', 'B', 'S', 'H', 'A', 'R', 'D', '\0'},
+                           3,
+                           static_cast<std::uint64_t>(config.N),
+                           config.Y0_mean,
+                           std::abs(config.Y0_err),
+                           config.Theta0_mean,
+                           std::abs(config.Theta0_err),
+                           config.seed,
+                           config.reservoir,
+                           config.keepInitial,
+                           spec.rawSamples,
+                           ensembleBlock,
+                           border->r1(),
+                           border->r2(),
+                           border->xEnd(),
+                           config.occupancyWidth,
+                           config.occupancyHeight,
+                           static_cast<std::uint64_t>(spec.index),
+                           static_cast<std::uint64_t>(spec.count),
+                           first,
+                           last};
+
+  // the merged result of the shard uses the same reservoirs as the run
+  auto result = makeEnsembleResult(config, border);
+  auto summary = makeSnapshot(*border, config);
+  HistogramSink histograms{summary, config.sink};
+  auto blockConfig = config;
+  blockConfig.sink = &histograms;
+  auto const tmp = path + ".tmp";
+  {
+    std::ofstream os{tmp, std::ios::binary | std::ios::trunc};
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto block = first; block != last; ++block) {
+      auto partial = runEnsembleBlock(blockConfig, border, block);
+      for (std::uint64_t x : {static_cast<std::uint64_t>(partial.accepted),
+                              static_cast<std::uint64_t>(partial.rejected)}) {
+        os.write(reinterpret_cast<const char*>(&x), sizeof(x));
+      }
+      // the moments are all the merge needs, in the order of the blocks;
+      // the values only go in the file on request, as they make it grow
+      // with N
+      for (auto sample : blockSamples(config.keepInitial, partial)) {
+        if (spec.rawSamples) {
+          sample->save(os);
+        } else {
+          sample->moments().save(os);
+        }
+      }
+      // the histograms and occupancy counts are integers, so those of the
+      // whole shard are written once at the end
+      mergeEnsembleBlock(result, partial);
+      if (config.sink != nullptr) config.sink->progress(result);
+    }
+    os.write(reinterpret_cast<const char*>(summary.histogramY),
+             sizeof(summary.histogramY));
+    os.write(reinterpret_cast<const char*>(summary.histogramTheta),
+             sizeof(summary.histogramTheta));
+    if (!result.occupancy.empty()) result.occupancy.save(os);
+    os.close();
+    if (!os) {
+      throw std::runtime_error("Impossible to write " + tmp);
+    }
+  }
+  // a partial file only appears once complete
+  std::filesystem::rename(tmp, path);
+  return result;
+}
+
+ShardedRun mergeShards(const std::vector<std::string>& paths) {
+  if (paths.empty()) {
+    throw std::runtime_error("No shards to merge");
+  }
+
+  std::vector<ShardFile> files;
+  files.reserve(paths.size());
+  for (auto const& path : paths) {
+    ShardFile file{path, {}, std::ifstream{path, std::ios::binary}};
+    file.is.read(reinterpret_cast<char*>(&file.header), sizeof(file.header));
+    if (!file.is ||
+        std::memcmp(file.header.magic, "TBSHARD", 8) != 0 ||
+        file.header.version != 3) {
+      throw std::runtime_error("Invalid shard " + path);
+    }
+    if (!files.empty() && std::memcmp(&file.header, &files.front().header,
+                                      shardRunBytes) != 0) {
+      throw std::runtime_error("Shard " + path + " belongs to a different run");
+    }
+    files.push_back(std::move(file));
+  }
+
+  std::sort(files.begin(), files.end(), [](auto const& a, auto const& b) {
+    return a.header.first < b.header.first;
+  });
+
+  auto const& run = files.front().header;
+  auto const blocks = ensembleBlocks(static_cast<int>(run.N));
+  if (run.block != ensembleBlock) {
+    throw std::runtime_error("Shard " + files.front().path +
+                             " uses blocks of a different size");
+  }
+  std::uint64_t next = 0;
+  for (auto const& file : files) {
+    if (file.header.first < next) {
+      throw std::runtime_error("Shard " + file.path + " overlaps another one");
+    }
+    if (file.header.first > next || file.header.last < file.header.first) {
+      throw std::runtime_error("Blocks " + std::to_string(next) + " to " +
+                               std::to_string(file.header.first) +
+                               " are missing from the shards");
+    }
+    next = file.header.last;
+  }
+  if (next != blocks) {
+    throw std::runtime_error("Blocks " + std::to_string(next) + " to " +
+                             std::to_string(blocks) +
+                             " are missing from the shards");
+  }
+
+  ShardedRun merged{{static_cast<int>(run.N), run.Y0_mean, run.Y0_err,
+                     run.Theta0_mean, run.Theta0_err, run.seed,
+                     static_cast<std::size_t>(run.reservoir),
+                     run.keepInitial != 0},
+                    createBorder(run.r1, run.r2, run.l),
+                    {{}, {}, 0, 0},
+                    run.rawSamples != 0,
+                    {}};
+  merged.config.occupancyWidth = run.occupancyWidth;
+  merged.config.occupancyHeight = run.occupancyHeight;
+  merged.summary = makeSnapshot(*merged.border, merged.config);
+  if (merged.rawSamples) {
+    merged.result = makeEnsembleResult(merged.config, merged.border.get());
+  } else if (run.occupancyWidth != 0) {
+    // no values will come, so nothing is reserved for them
+    merged.result.occupancy = OccupancyGrid{
+        run.occupancyWidth, run.occupancyHeight, *merged.border};
+  }
+
+  // every block goes through the same merge as in a single-process run
+  for (auto& file : files) {
+    for (auto block = file.header.first; block != file.header.last; ++block) {
+      MultipleResult partial{{}, {}, 0, 0};
+      std::uint64_t counts[2]{};
+      file.is.read(reinterpret_cast<char*>(counts), sizeof(counts));
+      partial.accepted = static_cast<int>(counts[0]);
+      partial.rejected = static_cast<int>(counts[1]);
+      if (merged.rawSamples) {
+        for (auto sample : blockSamples(merged.config.keepInitial, partial)) {
+          sample->load(file.is);
+        }
+        mergeEnsembleBlock(merged.result, partial);
+      } else {
+        merged.result.accepted += partial.accepted;
+        merged.result.rejected += partial.rejected;
+        for (auto sample :
+             blockSamples(merged.config.keepInitial, merged.result)) {
+          Moments moments;
+          moments.load(file.is);
+          sample->mergeMoments(moments);
+        }
+      }
+      if (!file.is) {
+        throw std::runtime_error("Truncated shard " + file.path);
+      }
+    }
+    Snapshot histograms{};
+    file.is.read(reinterpret_cast<char*>(histograms.histogramY),
+                 sizeof(histograms.histogramY));
+    file.is.read(reinterpret_cast<char*>(histograms.histogramTheta),
+                 sizeof(histograms.histogramTheta));
+    if (!file.is) {
+      throw std::runtime_error("Truncated shard " + file.path);
+    }
+    for (std::size_t i = 0; i != snapshotBins; ++i) {
+      merged.summary.histogramY[i] += histograms.histogramY[i];
+      merged.summary.histogramTheta[i] += histograms.histogramTheta[i];
+    }
+    if (!merged.result.occupancy.empty()) {
+      OccupancyGrid grid;
+      grid.load(file.is);
+      merged.result.occupancy.merge(grid);
+    }
+  }
+  recordProgress(merged.summary, merged.result);
+  merged.summary.done = 1;
+  return merged;
+}
+
+}  // namespace tb
@@ -0,0 +1,60 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "publish.hpp"
+#include "triangularbilliards.hpp"
+
+namespace tb {
+
+/// @brief One of count shards of a run, numbered from 0. Unless rawSamples
+/// is set, the partial file keeps only the moments of each block, not its
+/// values.
+struct ShardSpec {
+  int index;
+  int count;
+  bool rawSamples = false;
+};
+
+/// @brief First and past-the-end block of the shard. The blocks of a run are
+/// split in contiguous, disjoint ranges of (almost) equal size, so that each
+/// shard draws its own slice of the pseudo-random sequence of the run.
+std::pair<std::uint64_t, std::uint64_t> shardBlocks(int N, ShardSpec spec);
+
+/// @brief Runs the blocks of the shard and writes their partial results to a
+/// file: the parameters of the run, then the counts and the moments (or the
+/// whole samples, with rawSamples) of each block, and finally the histograms
+/// and occupancy grid of the shard. The shards of a run can be generated by
+/// independent processes, on any machine, and combined by mergeShards.
+/// Returns the result of the shard alone.
+MultipleResult runShard(const EnsembleConfig& config, const Border* border,
+                        ShardSpec spec, const std::string& path);
+
+/// @brief A run combined from the partial results of its shards. Without raw
+/// samples, the samples of the result hold no values, only their moments.
+struct ShardedRun {
+  EnsembleConfig config;
+  std::unique_ptr<Border> border;
+  MultipleResult result;
+  bool rawSamples;
+
+  /// @brief Counts, moments and histograms of the final Y and Theta.
+  Snapshot summary;
+};
+
+/// @brief Merges the partial files of all the shards of a run, given in any
+/// order. The blocks are merged in the order of the run, so the counts and
+/// moments (and the values, with raw samples) are identical to the ones of
+/// runMultipleSimulations with the same parameters.
+/// Throws if the files belong to different runs, overlap or leave blocks
+/// out.
+ShardedRun mergeShards(const std::vector<std::string>& paths);
+
+}  // namespace tb
+
+#endif
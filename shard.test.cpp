@@ -0,0 +1,172 @@
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+
+#include "doctest.h"
+#include "shard.hpp"
+
+TEST_CASE("Testing shardBlocks() function") {
+  auto const N = 10 * tb::ensembleBlock;
+  CHECK(tb::shardBlocks(N, {0, 1}) == std::pair<std::uint64_t, std::uint64_t>{
+                                          0, 10});
+  CHECK(tb::shardBlocks(N, {0, 3}).second == tb::shardBlocks(N, {1, 3}).first);
+  CHECK(tb::shardBlocks(N, {2, 3}).second == 10);
+  // more shards than blocks leaves some of them empty
+  auto const [first, last] = tb::shardBlocks(100, {0, 4});
+  CHECK(first == last);
+  CHECK_THROWS(tb::shardBlocks(N, {3, 3}));
+  CHECK_THROWS(tb::shardBlocks(N, {0, 0}));
+}
+
+TEST_CASE("Testing sharded runs") {
+  auto const directory = std::filesystem::temp_directory_path();
+  std::vector<std::string> paths;
+  for (int i = 0; i != 3; ++i) {
+    paths.push_back(
+        (directory / ("tb_shard.test." + std::to_string(i))).string());
+  }
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{4 * tb::ensembleBlock + 100, 5., 1., 0.785, 0.01,
+                            42, 0, true};
+  SUBCASE("Keeping all values") {}
+  SUBCASE("Keeping a reservoir") { config.reservoir = 1000; }
+  SUBCASE("Filling an occupancy grid") {
+    config.occupancyWidth = 64;
+    config.occupancyHeight = 32;
+  }
+
+  auto const single = tb::runMultipleSimulations(config, &border);
+  int accepted = 0;
+  for (int i = 0; i != 3; ++i) {
+    auto const& path = paths[static_cast<std::size_t>(i)];
+    accepted += tb::runShard(config, &border, {i, 3, true}, path).accepted;
+  }
+  CHECK(accepted == single.accepted);
+
+  SUBCASE("The merge of the shards is the single-process run") {
+    auto const merged = tb::mergeShards({paths[2], paths[0], paths[1]});
+    CHECK(merged.rawSamples);
+    CHECK(merged.config.N == config.N);
+    CHECK(merged.config.seed == config.seed);
+    CHECK(merged.border->r2() == border.r2());
+    auto const& result = merged.result;
+    CHECK(result.accepted == single.accepted);
+    CHECK(result.rejected == single.rejected);
+    CHECK(result.finalY.values() == single.finalY.values());
+    CHECK(result.finalTheta.values() == single.finalTheta.values());
+    CHECK(result.initialY.values() == single.initialY.values());
+    CHECK(result.initialTheta.values() == single.initialTheta.values());
+    CHECK(result.occupancy.counts() == single.occupancy.counts());
+    for (auto [a, b] : {std::pair{&result.finalY, &single.finalY},
+                        std::pair{&result.finalTheta, &single.finalTheta}}) {
+      auto const x = a->statistics();
+      auto const y = b->statistics();
+      CHECK(x.mean == y.mean);
+      CHECK(x.sigma == y.sigma);
+      CHECK(x.skewness == y.skewness);
+      CHECK(x.kurtosis == y.kurtosis);
+    }
+  }
+
+  SUBCASE("Missing shards") {
+    CHECK_THROWS(tb::mergeShards({paths[0], paths[2]}));
+    CHECK_THROWS(tb::mergeShards({paths[0], paths[1]}));
+  }
+
+  SUBCASE("Overlapping shards") {
+    CHECK_THROWS(tb::mergeShards({paths[0], paths[1], paths[1], paths[2]}));
+    auto const whole = (directory / "tb_shard.test.whole").string();
+    tb::runShard(config, &border, {0, 1, true}, whole);
+    CHECK_THROWS(tb::mergeShards({paths[0], whole}));
+    std::filesystem::remove(whole);
+  }
+
+  SUBCASE("Shards of a different run") {
+    SUBCASE("Another seed") {
+      config.seed = 43;
+      tb::runShard(config, &border, {1, 3, true}, paths[1]);
+    }
+    SUBCASE("Without raw samples") {
+      tb::runShard(config, &border, {1, 3}, paths[1]);
+    }
+    CHECK_THROWS(tb::mergeShards({paths[0], paths[1], paths[2]}));
+  }
+
+  SUBCASE("Truncated shards") {
+    std::filesystem::resize_file(paths[1],
+                                 std::filesystem::file_size(paths[1]) / 2);
+    CHECK_THROWS(tb::mergeShards({paths[0], paths[1], paths[2]}));
+  }
+
+  for (auto const& path : paths) std::filesystem::remove(path);
+}
+
+TEST_CASE("Testing shards without raw samples") {
+  auto const directory = std::filesystem::temp_directory_path();
+  auto const compact = (directory / "tb_shard.test.compact").string();
+  auto const raw = (directory / "tb_shard.test.raw").string();
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{4 * tb::ensembleBlock + 100, 5., 1., 0.785, 0.01,
+                            42, 0, true};
+  config.occupancyWidth = 64;
+  config.occupancyHeight = 32;
+
+  auto const single = tb::runMultipleSimulations(config, &border);
+  std::vector<std::string> paths;
+  for (int i = 0; i != 2; ++i) {
+    paths.push_back(compact + std::to_string(i));
+    tb::runShard(config, &border, {i, 2}, paths.back());
+  }
+  tb::runShard(config, &border, {0, 1, true}, raw);
+  // the values of the blocks are what makes a partial file grow with N
+  CHECK(std::filesystem::file_size(paths[0]) * 100 <
+        std::filesystem::file_size(raw));
+
+  auto const merged = tb::mergeShards({paths[1], paths[0]});
+  CHECK_FALSE(merged.rawSamples);
+  auto const& result = merged.result;
+  CHECK(result.accepted == single.accepted);
+  CHECK(result.rejected == single.rejected);
+  CHECK(result.occupancy.counts() == single.occupancy.counts());
+  for (auto [a, b] : {std::pair{&result.finalY, &single.finalY},
+                      std::pair{&result.finalTheta, &single.finalTheta},
+                      std::pair{&result.initialY, &single.initialY},
+                      std::pair{&result.initialTheta, &single.initialTheta}}) {
+    CHECK(a->values().empty());
+    auto const& x = a->moments();
+    auto const& y = b->moments();
+    CHECK(x.count() == y.count());
+    CHECK(x.mean() == y.mean());
+    CHECK(x.m2() == y.m2());
+    CHECK(x.m3() == y.m3());
+    CHECK(x.m4() == y.m4());
+  }
+  // no value is left, yet the statistics are those of the single run
+  for (auto [a, b] : {std::pair{&result.finalY, &single.finalY},
+                      std::pair{&result.finalTheta, &single.finalTheta}}) {
+    auto const x = a->statistics();
+    auto const y = b->statistics();
+    CHECK(x.mean == y.mean);
+    CHECK(x.sigma == y.sigma);
+    CHECK(x.skewness == y.skewness);
+    CHECK(x.kurtosis == y.kurtosis);
+  }
+
+  auto const& summary = merged.summary;
+  CHECK(summary.accepted == static_cast<std::uint64_t>(single.accepted));
+  CHECK(std::accumulate(std::begin(summary.histogramY),
+                        std::end(summary.histogramY), std::uint64_t{0}) ==
+        summary.accepted);
+  CHECK(std::accumulate(std::begin(summary.histogramTheta),
+                        std::end(summary.histogramTheta), std::uint64_t{0}) ==
+        summary.accepted);
+  // the histograms do not depend on how the run is split
+  auto const whole = tb::mergeShards({raw});
+  CHECK(std::equal(std::begin(summary.histogramY), std::end(summary.histogramY),
+                   std::begin(whole.summary.histogramY)));
+
+  for (auto const& path : paths) std::filesystem::remove(path);
+  std::filesystem::remove(raw);
+}
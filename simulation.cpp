@@ -1,7 +1,57 @@
 #include "simulation.hpp"
 
+#include <charconv>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include "collisionstream.hpp"
+#include "live.hpp"
+#include "segmentindex.hpp"
+
 namespace tb {
 
+namespace {
+
+/// @brief Appends a square dot of the given half side, as a quad, so that any
+/// number of dots is drawn with a single call.
+void appendDot(sf::VertexArray& dots, const sf::Vector2f& center, float half,
+               const sf::Color& color) {
+  dots.append({{center.x - half, center.y - half}, color});
+  dots.append({{center.x + half, center.y - half}, color});
+  dots.append({{center.x + half, center.y + half}, color});
+  dots.append({{center.x - half, center.y + half}, color});
+}
+
+/// @brief Colour of a trajectory from its final angle, from blue for -pi/2
+/// to red for pi/2.
+sf::Color finalStateColor(double theta, sf::Uint8 alpha) {
+  auto const t = std::clamp(theta / M_PI + 0.5, 0., 1.);
+  auto const mix = [t](double a, double b) {
+    return static_cast<sf::Uint8>(a + (b - a) * t);
+  };
+  return {mix(0., 255.), mix(90., 60.), mix(255., 0.), alpha};
+}
+
+/// @brief Colour of a value in [0, 1], from black through purple and orange
+/// to pale yellow.
+sf::Color heatColor(double t) {
+  constexpr double stops[][3] = {{0., 0., 4.},
+                                 {120., 28., 109.},
+                                 {237., 105., 37.},
+                                 {252., 255., 164.}};
+  auto const x = std::clamp(t, 0., 1.) * 3.;
+  auto const i = std::min(static_cast<std::size_t>(x), std::size_t{2});
+  auto const f = x - static_cast<double>(i);
+  auto const mix = [&](int c) {
+    return static_cast<sf::Uint8>(stops[i][c] +
+                                  (stops[i + 1][c] - stops[i][c]) * f);
+  };
+  return {mix(0), mix(1), mix(2)};
+}
+
+}  // namespace
+
 sf::Vector2f normalize(const sf::Vector2f& v) {
   float length = std::sqrt(v.x * v.x + v.y * v.y);
   if (length != 0.f) return v / length;
@@ -13,53 +63,43 @@ float distance(const sf::Vector2f& a, const sf::Vector2f& b) {
 }
 
 std::string formatCoords(const tb::Particle& pos) {
-  std::ostringstream ss;
-  ss << std::fixed << std::setprecision(2);
-  ss << "X: " << pos.x << "  Y: " << pos.y << "  Angle: " << pos.theta;
-  return ss.str();
+  CoordsBuffer buffer;
+  return std::string{formatCoords(buffer, pos)};
 }
 
-void runSimulation(const std::vector<tb::Particle>& collisions,
-                   const tb::Border* borders) {
+std::string_view formatCoords(CoordsBuffer& buffer, const tb::Particle& pos) {
+  // one character is left for the terminator
+  auto const end = buffer.data() + buffer.size() - 1;
+  auto out = buffer.data();
+  auto put = [&](std::string_view label, double value) {
+    auto const n = std::min(label.size(), static_cast<std::size_t>(end - out));
+    out = std::copy_n(label.data(), n, out);
+    auto const [last, error] =
+        std::to_chars(out, end, value, std::chars_format::fixed, 2);
+    if (error == std::errc{}) out = last;
+  };
+  put("X: ", pos.x);
+  put("  Y: ", pos.y);
+  put("  Angle: ", pos.theta);
+  *out = '\0';
+  return {buffer.data(), static_cast<std::size_t>(out - buffer.data())};
+}
+
+namespace {
+
+void animate(CollisionStream& stream, const tb::Border* borders) {
   const float windowWidth = 1000.f;
   const float windowHeight = 600.f;
   const float margin = 40.f;
 
-  sf::RenderWindow window(
-      sf::VideoMode(static_cast<unsigned int>(windowWidth),
-                    static_cast<unsigned int>(windowHeight)),
-      "Triangular Billiards");
-
-  std::vector<sf::Vector2f> path;
-  for (const auto& p : collisions) path.emplace_back(p.x, p.y);
-
-  auto computeBounds =
-      [](const std::vector<sf::Vector2f>& pts) -> sf::FloatRect {
-    if (pts.empty()) return {};
-    float minX = pts[0].x, maxX = pts[0].x;
-    float minY = pts[0].y, maxY = pts[0].y;
-    for (const auto& pt : pts) {
-      minX = std::min(minX, pt.x);
-      maxX = std::max(maxX, pt.x);
-      minY = std::min(minY, pt.y);
-      maxY = std::max(maxY, pt.y);
-    }
-    return {minX, minY, maxX - minX, maxY - minY};
-  };
-
-  sf::FloatRect bounds = computeBounds(path);
-
   float r1 = static_cast<float>(borders->r1());
   float r2 = static_cast<float>(borders->r2());
   float L = static_cast<float>(borders->xEnd());
+  float yRange = std::max(r1, r2);
 
-  bounds.left = std::min(bounds.left, 0.f);
-  bounds.width = std::max(bounds.width, L);
-  bounds.top = std::min(bounds.top, -r1);
-  bounds.height = std::max(bounds.height, std::max(r1, r2) * 2.f);
-
-  float scaleX = (windowWidth - 2 * margin) / bounds.width;
-  float scaleY = (windowHeight - 2 * margin) / bounds.height;
+  // the trajectory is not known in advance, but it never leaves the billiard
+  float scaleX = (windowWidth - 2 * margin) / L;
+  float scaleY = (windowHeight - 2 * margin) / (2.f * yRange);
   float scale = std::min(scaleX, scaleY);
   float originY = windowHeight / 2.f;
 
@@ -71,34 +111,95 @@ void runSimulation(const std::vector<tb::Particle>& collisions,
       [scale, originY](const sf::Vector2f& winPos) -> sf::Vector2f {
     return {winPos.x / scale, (originY - winPos.y) / scale};
   };
+  auto toVector = [](const tb::Particle& p) {
+    return sf::Vector2f{static_cast<float>(p.x), static_cast<float>(p.y)};
+  };
+
+  // the last position reached and the next one, once it is available
+  tb::Particle previous{};
+  tb::Particle target{};
+  bool hasTarget = false;
+  stream.next(previous, true);
+
+  sf::RenderWindow window(
+      sf::VideoMode(static_cast<unsigned int>(windowWidth),
+                    static_cast<unsigned int>(windowHeight)),
+      "Triangular Billiards");
+  // no more frames than a screen shows, leaving the CPU to the simulations
+  // running alongside
+  window.setFramerateLimit(60);
+
+  // the billiard is drawn through a view that zooms, up to maxZoom times,
+  // and pans over it, the texts without it
+  constexpr float maxZoom = 64.f;
+  sf::View view = window.getDefaultView();
+  bool viewMoved = false;
+  bool dragging = false;
+  sf::Vector2i dragPixel{};
+  auto zoomAt = [&](sf::Vector2i pixel, float factor) {
+    auto const size = view.getSize().x * factor;
+    factor = std::clamp(size, windowWidth / maxZoom, windowWidth) /
+             view.getSize().x;
+    // the point under the cursor stays where it is
+    auto const before = window.mapPixelToCoords(pixel, view);
+    view.zoom(factor);
+    view.move(before - window.mapPixelToCoords(pixel, view));
+    viewMoved = true;
+  };
 
   sf::CircleShape particle(2.f);
   particle.setOrigin(2.f, 2.f);
   particle.setFillColor(sf::Color::Red);
-  particle.setPosition(toWindowCoords(path[0]));
-
-  sf::Vertex topBorder[] = {
-      sf::Vertex(toWindowCoords({0.f, r1}), sf::Color::Yellow),
-      sf::Vertex(toWindowCoords({L, r2}), sf::Color::Yellow)};
-  sf::Vertex bottomBorder[] = {
-      sf::Vertex(toWindowCoords({0.f, -r1}), sf::Color::Red),
-      sf::Vertex(toWindowCoords({L, -r2}), sf::Color::Red)};
-  sf::Vertex centerLine[] = {
-      sf::Vertex({0.f, originY}, sf::Color(55, 55, 55, 120)),
-      sf::Vertex({windowWidth, originY}, sf::Color(55, 55, 55, 120))};
-  sf::Vertex l_axis[] = {
-      sf::Vertex(toWindowCoords({L, bounds.top - 1}),
-                 sf::Color(55, 55, 55, 120)),
-      sf::Vertex(toWindowCoords({L, bounds.top + bounds.height + 1}),
-                 sf::Color(55, 55, 55, 120))};
-
-  std::vector<sf::CircleShape> trailDots;
-  std::vector<sf::Text> waypointTexts;
-  std::vector<std::string> passedCoords;
-
-  size_t currentTarget = 1;
-  float trailTimer = 0.f;
-  float lastY = path[0].y;
+  particle.setPosition(toWindowCoords(toVector(previous)));
+
+  // everything that does not change during the animation, one line per pair
+  sf::VertexArray frame{sf::Lines};
+  frame.append({toWindowCoords({0.f, r1}), sf::Color::Yellow});
+  frame.append({toWindowCoords({L, r2}), sf::Color::Yellow});
+  frame.append({toWindowCoords({0.f, -r1}), sf::Color::Red});
+  frame.append({toWindowCoords({L, -r2}), sf::Color::Red});
+  frame.append({{0.f, originY}, sf::Color(55, 55, 55, 120)});
+  frame.append({{windowWidth, originY}, sf::Color(55, 55, 55, 120)});
+  frame.append({toWindowCoords({L, -yRange - 1}), sf::Color(55, 55, 55, 120)});
+  frame.append({toWindowCoords({L, yRange + 1}), sf::Color(55, 55, 55, 120)});
+
+  // the path travelled and the collisions reached are drawn from the
+  // coarsest level of detail that merges only sub-pixel segments, with at
+  // most maxVertices points in the whole view when not zoomed, so that a
+  // trajectory of millions of collisions near the vertex costs the same per
+  // frame as a short one; the finest level keeps what the view zoomed in the
+  // most shows. Each level keeps a bounded number of points, the finest ones
+  // only the latest part of the path
+  constexpr std::size_t maxVertices = 1 << 14;
+  // collisions reached so far, of which only the latest maxHistory are
+  // listed
+  constexpr std::size_t maxHistory = 1 << 16;
+  tb::CollisionTrail trail{1. / (maxZoom * scale), maxHistory};
+  trail.restart(previous);
+  auto const& lod = trail.path();
+  // the segments of the level drawn, so that only those in the view are
+  // submitted when zoomed in; rebuilt when the level drops its oldest points
+  tb::SegmentIndex index{{0., -yRange}, {L, yRange}, 128, 64};
+  std::size_t indexedLevel = lod.levels();
+  std::size_t indexedDropped = 0;
+  std::vector<std::uint32_t> visible;
+  sf::VertexArray path{sf::Lines};
+  sf::VertexArray waypointDots{sf::Quads};
+  // the points of the lod the vertex arrays were built from
+  std::size_t builtPoints = 0;
+  // the collisions listed in a fixed number of rows scrolled over them, so
+  // that only the visible ones are formatted and drawn
+  constexpr std::size_t waypointRows = 26;
+  std::array<sf::Text, waypointRows> waypointTexts;
+  std::size_t firstRow = 0;
+  bool followLatest = true;
+  // window of the list the rows currently show
+  std::size_t shownFirst = 0;
+  std::size_t shownCount = 0;
+  CoordsBuffer coordsBuffer;
+  CoordsBuffer shownCoords{};
+
+  float lastY = static_cast<float>(previous.y);
   bool isStopped = false;
   bool pathCompleted = false;
 
@@ -115,6 +216,13 @@ void runSimulation(const std::vector<tb::Particle>& collisions,
   coordText.setCharacterSize(14);
   coordText.setFillColor(sf::Color::White);
 
+  for (std::size_t i = 0; i != waypointRows; ++i) {
+    waypointTexts[i].setFont(font);
+    waypointTexts[i].setCharacterSize(14);
+    waypointTexts[i].setFillColor(sf::Color::White);
+    waypointTexts[i].setPosition(750.f, 30.f + static_cast<float>(i) * 20.f);
+  }
+
   sf::Text restartHint("Press Space to restart", font, 14);
   restartHint.setFillColor(sf::Color(180, 180, 180));
   restartHint.setPosition(750.f, 550.f);
@@ -126,20 +234,33 @@ void runSimulation(const std::vector<tb::Particle>& collisions,
   float speed = 150.f;
 
   auto restartSimulation = [&]() {
-    particle.setPosition(toWindowCoords(path[0]));
+    stream.restart();
+    stream.next(previous, true);
+    hasTarget = false;
+    particle.setPosition(toWindowCoords(toVector(previous)));
     particle.setFillColor(sf::Color::Red);
-    trailDots.clear();
-    waypointTexts.clear();
-    passedCoords.clear();
-    currentTarget = 1;
+    trail.restart(previous);
+    indexedLevel = lod.levels();
+    builtPoints = 0;
+    firstRow = 0;
+    followLatest = true;
+    shownCount = 0;
     pathCompleted = false;
     isStopped = false;
     moveClock.restart();
   };
 
+  bool displayed = false;
   while (window.isOpen()) {
     sf::Event event;
-    while (window.pollEvent(event)) {
+    // with nothing moving the frame shown stays right, so the loop sleeps
+    // until an event instead of drawing it again; the time spent waiting
+    // is not animated
+    bool pending = displayed && (isStopped || pathCompleted) &&
+                   window.waitEvent(event);
+    if (pending) moveClock.restart();
+    while (pending || window.pollEvent(event)) {
+      pending = false;
       if (event.type == sf::Event::Closed) window.close();
       if (event.type == sf::Event::KeyPressed &&
           event.key.code == sf::Keyboard::Space) {
@@ -152,65 +273,170 @@ void runSimulation(const std::vector<tb::Particle>& collisions,
         if (event.key.code == sf::Keyboard::Up) speed += 20.f;
         if (event.key.code == sf::Keyboard::Down)
           speed = std::max(20.f, speed - 20.f);
+        // scrolling the list stops following the latest collision, End
+        // follows it again
+        if (event.key.code == sf::Keyboard::PageUp) {
+          firstRow -= std::min(firstRow, waypointRows);
+          followLatest = false;
+        }
+        if (event.key.code == sf::Keyboard::PageDown) firstRow += waypointRows;
+        if (event.key.code == sf::Keyboard::Home) {
+          firstRow = 0;
+          followLatest = false;
+        }
+        if (event.key.code == sf::Keyboard::End) followLatest = true;
+        auto const center = window.mapCoordsToPixel(view.getCenter(), view);
+        if (event.key.code == sf::Keyboard::Equal ||
+            event.key.code == sf::Keyboard::Add) {
+          zoomAt(center, 0.5f);
+        }
+        if (event.key.code == sf::Keyboard::Hyphen ||
+            event.key.code == sf::Keyboard::Subtract) {
+          zoomAt(center, 2.f);
+        }
+        if (event.key.code == sf::Keyboard::R) {
+          view = window.getDefaultView();
+          viewMoved = true;
+        }
+      }
+      // the wheel zooms over the billiard and scrolls over the list, the
+      // left button drags the view
+      if (event.type == sf::Event::MouseWheelScrolled &&
+          event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel &&
+          event.mouseWheelScroll.x < 740) {
+        zoomAt({event.mouseWheelScroll.x, event.mouseWheelScroll.y},
+               event.mouseWheelScroll.delta > 0.f ? 0.8f : 1.25f);
+      } else if (event.type == sf::Event::MouseWheelScrolled &&
+                 event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel) {
+        if (event.mouseWheelScroll.delta > 0.f) {
+          firstRow -= std::min(firstRow, std::size_t{3});
+          followLatest = false;
+        } else {
+          firstRow += 3;
+        }
+      }
+      if (event.type == sf::Event::MouseButtonPressed &&
+          event.mouseButton.button == sf::Mouse::Left) {
+        dragging = true;
+        dragPixel = {event.mouseButton.x, event.mouseButton.y};
+      }
+      if (event.type == sf::Event::MouseButtonReleased &&
+          event.mouseButton.button == sf::Mouse::Left) {
+        dragging = false;
+      }
+      if (event.type == sf::Event::MouseMoved && dragging) {
+        sf::Vector2i const pixel{event.mouseMove.x, event.mouseMove.y};
+        view.move(window.mapPixelToCoords(dragPixel, view) -
+                  window.mapPixelToCoords(pixel, view));
+        dragPixel = pixel;
+        viewMoved = true;
       }
     }
 
     float dt = moveClock.restart().asSeconds();
 
-    if (!isStopped && !pathCompleted && currentTarget < path.size()) {
+    // the particle moves by speed * dt along the path each frame, through as
+    // many collisions as that covers, so that sub-pixel segments do not take
+    // a frame each; it waits where it is while the next position is computed
+    auto budget = isStopped ? 0.f : speed * dt;
+    for (int steps = 0; steps != 1 << 16 && !pathCompleted; ++steps) {
+      if (!hasTarget) {
+        auto const status = stream.next(target);
+        if (status == CollisionStream::Status::Waiting) break;
+        if (status == CollisionStream::Status::Finished) {
+          pathCompleted = true;
+          break;
+        }
+        hasTarget = true;
+      }
+      if (budget <= 0.f) break;
+
       sf::Vector2f currentPos = particle.getPosition();
-      sf::Vector2f targetPos = toWindowCoords(path[currentTarget]);
+      sf::Vector2f targetPos = toWindowCoords(toVector(target));
       sf::Vector2f direction = targetPos - currentPos;
       float len = std::hypot(direction.x, direction.y);
-      if (len != 0.f) direction /= len;
-
-      sf::Vector2f moveVec = direction * speed * dt;
-
-      if (len > speed * dt) {
-        particle.move(moveVec);
-      } else {
-        particle.setPosition(targetPos);
-
-        std::string label = formatCoords(collisions[currentTarget]);
-        passedCoords.push_back(label);
+      if (len > budget) {
+        particle.move(direction / len * budget);
+        break;
+      }
+      budget -= len;
+      particle.setPosition(targetPos);
+      trail.reach(target);
+      previous = target;
+      hasTarget = false;
+    }
 
-        sf::Text waypointLabel;
-        waypointLabel.setFont(font);
-        waypointLabel.setCharacterSize(14);
-        waypointLabel.setFillColor(sf::Color::White);
-        waypointLabel.setString(label);
-        waypointLabel.setPosition(
-            750.f, 30.f + static_cast<float>(waypointTexts.size()) * 20.f);
-        waypointTexts.push_back(waypointLabel);
+    // the view zoomed in by a factor z shows about 1 / z^2 of the billiard,
+    // so that it can afford a level with z^2 times the points
+    auto const pixel = view.getSize().x / windowWidth;
+    if (lod.size() != builtPoints || viewMoved) {
+      auto const k = lod.select(
+          pixel / scale,
+          static_cast<std::size_t>(static_cast<float>(maxVertices) /
+                                   (pixel * pixel)));
+      auto const level = lod.level(k);
+      if (k != indexedLevel || lod.dropped(k) != indexedDropped) {
+        index.clear();
+        indexedLevel = k;
+        indexedDropped = lod.dropped(k);
+      }
+      // all the segments but the last, whose end is replaced by the next
+      // point while it is closer than the tolerance of the level
+      while (index.size() + 2 < level.size()) {
+        index.add(level[index.size()], level[index.size() + 1]);
+      }
 
-        currentTarget++;
-        if (currentTarget >= path.size()) pathCompleted = true;
+      auto const topLeft =
+          fromWindowCoords(view.getCenter() - view.getSize() / 2.f);
+      auto const bottomRight =
+          fromWindowCoords(view.getCenter() + view.getSize() / 2.f);
+      index.query({topLeft.x, bottomRight.y}, {bottomRight.x, topLeft.y},
+                  visible);
+      if (level.size() >= 2) {
+        visible.push_back(static_cast<std::uint32_t>(level.size() - 2));
       }
-    }
 
-    trailTimer += dt;
-    if (trailTimer >= 0.02f && !pathCompleted) {
-      trailTimer = 0.f;
-      sf::CircleShape dot(1.f);
-      dot.setFillColor(sf::Color(0, 55, 155, 120));
-      dot.setOrigin(1.f, 1.f);
-      dot.setPosition(particle.getPosition());
-      trailDots.push_back(dot);
+      path.clear();
+      waypointDots.clear();
+      sf::Color const pathColor{0, 55, 155, 160};
+      auto const toPosition = [&](const tb::LodPoint& p) {
+        return toWindowCoords(
+            {static_cast<float>(p.x), static_cast<float>(p.y)});
+      };
+      for (auto const i : visible) {
+        auto const end = toPosition(level[i + 1]);
+        path.append({toPosition(level[i]), pathColor});
+        path.append({end, pathColor});
+        appendDot(waypointDots, end, 2.f * pixel,
+                  sf::Color(200, 200, 200, 160));
+      }
+      // the last segment follows the particle
+      path.append({toPosition(level.back()), pathColor});
+      path.append({particle.getPosition(), pathColor});
+      builtPoints = lod.size();
+      viewMoved = false;
     }
+    path[path.getVertexCount() - 1].position = particle.getPosition();
+    particle.setScale(pixel, pixel);
 
     sf::Vector2f currentWorldPos = fromWindowCoords(particle.getPosition());
     float theta = 0.f;
-    if (currentTarget > 0 && currentTarget < path.size()) {
-      sf::Vector2f prev = path[currentTarget - 1];
-      sf::Vector2f next = path[currentTarget];
-      sf::Vector2f dir = normalize(next - prev);
+    if (hasTarget) {
+      sf::Vector2f dir = normalize(toVector(target) - toVector(previous));
       theta = std::atan2(dir.y, dir.x);
     }
 
     tb::Particle currentLive{currentWorldPos.x, currentWorldPos.y, theta};
-    coordText.setString(formatCoords(currentLive));
-    coordText.setPosition(particle.getPosition().x + 10.f,
-                          particle.getPosition().y - 20.f);
+    // the text is only rebuilt when the formatted coordinates change
+    auto const coords = formatCoords(coordsBuffer, currentLive);
+    if (coords != shownCoords.data()) {
+      std::copy_n(coords.data(), coords.size() + 1, shownCoords.data());
+      coordText.setString(shownCoords.data());
+    }
+    auto const particlePixel =
+        window.mapCoordsToPixel(particle.getPosition(), view);
+    coordText.setPosition(static_cast<float>(particlePixel.x) + 10.f,
+                          static_cast<float>(particlePixel.y) - 20.f);
 
     if (currentWorldPos.y < lastY) {
       coordText.setFillColor(sf::Color::Red);
@@ -221,21 +447,459 @@ void runSimulation(const std::vector<tb::Particle>& collisions,
     }
     lastY = currentWorldPos.y;
 
+    auto const passed = trail.size();
+    auto const lastFirstRow = passed > waypointRows ? passed - waypointRows : 0;
+    if (followLatest || firstRow >= lastFirstRow) {
+      firstRow = lastFirstRow;
+      followLatest = true;
+    }
+    firstRow = std::max(firstRow, trail.first());
+    auto const shown = std::min(waypointRows, passed - firstRow);
+    if (firstRow != shownFirst || shown != shownCount) {
+      for (std::size_t i = 0; i != shown; ++i) {
+        waypointTexts[i].setString(
+            formatCoords(coordsBuffer, trail[firstRow + i]).data());
+      }
+      shownFirst = firstRow;
+      shownCount = shown;
+    }
+
     window.clear(sf::Color::Black);
-    for (const auto& dot : trailDots) window.draw(dot);
+    window.setView(view);
+    window.draw(path);
+    window.draw(waypointDots);
     window.draw(particle);
+    window.draw(frame);
+    window.setView(window.getDefaultView());
     window.draw(coordText);
-    window.draw(topBorder, 2, sf::Lines);
-    window.draw(bottomBorder, 2, sf::Lines);
-    window.draw(centerLine, 2, sf::Lines);
-    window.draw(l_axis, 2, sf::Lines);
-    for (const auto& text : waypointTexts) window.draw(text);
+    for (std::size_t i = 0; i != shownCount; ++i) {
+      window.draw(waypointTexts[i]);
+    }
     if (pathCompleted)
       window.draw(restartHint);
     else
       window.draw(pauseHint);
     window.display();
+    displayed = true;
   }
 }
 
+}  // namespace
+
+void runSimulation(const std::vector<tb::Particle>& collisions,
+                   const tb::Border* borders) {
+  if (collisions.empty()) return;
+  CollisionStream stream{collisions};
+  animate(stream, borders);
+}
+
+void runSimulation(const tb::Particle& start, const tb::Border* borders) {
+  CollisionStream stream{start, borders};
+  animate(stream, borders);
+}
+
+void runEnsembleSimulation(const std::vector<tb::Trajectory>& trajectories,
+                           const tb::Border* borders) {
+  const float windowWidth = 1000.f;
+  const float windowHeight = 600.f;
+  const float margin = 40.f;
+
+  float r1 = static_cast<float>(borders->r1());
+  float r2 = static_cast<float>(borders->r2());
+  float L = static_cast<float>(borders->xEnd());
+  float scale = std::min((windowWidth - 2 * margin) / L,
+                         (windowHeight - 2 * margin) / (2 * std::max(r1, r2)));
+  float originY = windowHeight / 2.f;
+  auto toWindowCoords = [scale, originY](const tb::Particle& p) {
+    return sf::Vector2f{static_cast<float>(p.x) * scale,
+                        originY - static_cast<float>(p.y) * scale};
+  };
+
+  // the segments are ordered by bounce, the k-th segment of every trajectory
+  // after the (k-1)-th ones, so that drawing the first firstVertex[k]
+  // vertices shows all the trajectories up to their k-th bounce: the whole
+  // ensemble is animated with a single draw call per frame
+  std::size_t bounces = 0;
+  for (const auto& traj : trajectories) {
+    bounces = std::max(bounces, traj.size() - 1);
+  }
+  std::vector<std::size_t> endingAt(bounces + 1, 0);
+  for (const auto& traj : trajectories) ++endingAt[traj.size() - 1];
+  std::vector<std::size_t> firstVertex(bounces + 1, 0);
+  auto remaining = trajectories.size();
+  for (std::size_t k = 0; k != bounces; ++k) {
+    remaining -= endingAt[k];
+    firstVertex[k + 1] = firstVertex[k] + 2 * remaining;
+  }
+
+  std::vector<sf::Vertex> vertices(firstVertex.back());
+  {
+    auto next = firstVertex;
+    for (const auto& traj : trajectories) {
+      auto const& positions = traj.positions();
+      // more trajectories make each of them fainter
+      auto const color = finalStateColor(
+          traj.getFinalPosition().theta,
+          static_cast<sf::Uint8>(std::clamp(
+              4000. / static_cast<double>(trajectories.size()), 12., 200.)));
+      for (std::size_t k = 0; k + 1 < positions.size(); ++k) {
+        vertices[next[k]++] = {toWindowCoords(positions[k]), color};
+        vertices[next[k]++] = {toWindowCoords(positions[k + 1]), color};
+      }
+    }
+  }
+
+  sf::RenderWindow window(
+      sf::VideoMode(static_cast<unsigned int>(windowWidth),
+                    static_cast<unsigned int>(windowHeight)),
+      "Triangular Billiards - Ensemble");
+  window.setFramerateLimit(60);
+
+  // the trajectories are uploaded once to the GPU when possible
+  sf::VertexBuffer buffer{sf::Lines, sf::VertexBuffer::Static};
+  bool const onGpu = sf::VertexBuffer::isAvailable() &&
+                     buffer.create(vertices.size()) &&
+                     buffer.update(vertices.data());
+
+  sf::VertexArray frame{sf::Lines};
+  frame.append({toWindowCoords({0., r1, 0.}), sf::Color::Yellow});
+  frame.append({toWindowCoords({L, r2, 0.}), sf::Color::Yellow});
+  frame.append({toWindowCoords({0., -r1, 0.}), sf::Color::Red});
+  frame.append({toWindowCoords({L, -r2, 0.}), sf::Color::Red});
+  frame.append({{0.f, originY}, sf::Color(55, 55, 55, 120)});
+  frame.append({{windowWidth, originY}, sf::Color(55, 55, 55, 120)});
+
+  sf::Font font;
+  if (!font.loadFromFile("arial.ttf")) {
+    std::cerr << "Failed to load font!" << std::endl;
+    return;
+  }
+  sf::Text hint("Press A to animate, Space to pause", font, 14);
+  hint.setFillColor(sf::Color(180, 180, 180));
+  hint.setPosition(700.f, 550.f);
+
+  bool animated = false;
+  bool isStopped = false;
+  float shown = 0.f;
+  float bouncesPerSecond = 10.f;
+  sf::Clock moveClock;
+
+  bool displayed = false;
+  while (window.isOpen()) {
+    sf::Event event;
+    // with nothing moving the frame shown stays right, so the loop sleeps
+    // until an event instead of drawing it again; the time spent waiting
+    // is not animated
+    bool pending = displayed &&
+                   (!animated || isStopped ||
+                    shown >= static_cast<float>(bounces)) &&
+                   window.waitEvent(event);
+    if (pending) moveClock.restart();
+    while (pending || window.pollEvent(event)) {
+      pending = false;
+      if (event.type == sf::Event::Closed) window.close();
+      if (event.type == sf::Event::KeyPressed) {
+        if (event.key.code == sf::Keyboard::A) {
+          animated = !animated;
+          shown = 0.f;
+          isStopped = false;
+        }
+        if (event.key.code == sf::Keyboard::Space) {
+          if (shown >= static_cast<float>(bounces))
+            shown = 0.f;
+          else
+            isStopped = !isStopped;
+        }
+        if (event.key.code == sf::Keyboard::Up) bouncesPerSecond *= 1.5f;
+        if (event.key.code == sf::Keyboard::Down)
+          bouncesPerSecond = std::max(1.f, bouncesPerSecond / 1.5f);
+      }
+    }
+
+    float dt = moveClock.restart().asSeconds();
+    if (animated && !isStopped) {
+      shown = std::min(shown + bouncesPerSecond * dt,
+                       static_cast<float>(bounces));
+    }
+    auto const count =
+        animated ? firstVertex[static_cast<std::size_t>(shown)]
+                 : vertices.size();
+
+    window.clear(sf::Color::Black);
+    if (onGpu) {
+      window.draw(buffer, 0, count);
+    } else {
+      window.draw(vertices.data(), count, sf::Lines);
+    }
+    window.draw(frame);
+    window.draw(hint);
+    window.display();
+    displayed = true;
+  }
+}
+
+sf::Image occupancyImage(const tb::OccupancyGrid& grid, bool logScale) {
+  sf::Image image;
+  image.create(grid.width(), grid.height());
+  auto const max = static_cast<double>(grid.max());
+  auto const scale = [logScale](double c) {
+    return logScale ? std::log1p(c) : c;
+  };
+  auto const top = max > 0. ? scale(max) : 1.;
+  for (unsigned row = 0; row != grid.height(); ++row) {
+    for (unsigned column = 0; column != grid.width(); ++column) {
+      auto const c = static_cast<double>(grid.at(column, row));
+      // the first row of the image is the top one
+      image.setPixel(column, grid.height() - 1 - row,
+                     heatColor(scale(c) / top));
+    }
+  }
+  return image;
+}
+
+void runOccupancyView(const tb::OccupancyGrid& grid,
+                      const tb::Border* borders) {
+  const float windowWidth = 1000.f;
+  const float windowHeight = 600.f;
+  const float margin = 40.f;
+
+  float r1 = static_cast<float>(borders->r1());
+  float r2 = static_cast<float>(borders->r2());
+  float L = static_cast<float>(borders->xEnd());
+  float yRange = std::max(r1, r2);
+  float scale = std::min((windowWidth - 2 * margin) / L,
+                         (windowHeight - 2 * margin) / (2 * yRange));
+  float originY = windowHeight / 2.f;
+  auto toWindowCoords = [scale, originY](float x, float y) {
+    return sf::Vector2f{x * scale, originY - y * scale};
+  };
+
+  sf::RenderWindow window(
+      sf::VideoMode(static_cast<unsigned int>(windowWidth),
+                    static_cast<unsigned int>(windowHeight)),
+      "Triangular Billiards - Occupancy");
+  window.setFramerateLimit(60);
+
+  bool logScale = true;
+  sf::Texture texture;
+  if (!texture.loadFromImage(occupancyImage(grid, logScale))) {
+    std::cerr << "Failed to create the occupancy texture!" << std::endl;
+    return;
+  }
+  // the grid covers [0, L] x [-yRange, yRange]
+  sf::Sprite heatmap{texture};
+  heatmap.setPosition(toWindowCoords(0.f, yRange));
+  heatmap.setScale(L * scale / static_cast<float>(grid.width()),
+                   2 * yRange * scale / static_cast<float>(grid.height()));
+
+  sf::VertexArray frame{sf::Lines};
+  frame.append({toWindowCoords(0.f, r1), sf::Color::Yellow});
+  frame.append({toWindowCoords(L, r2), sf::Color::Yellow});
+  frame.append({toWindowCoords(0.f, -r1), sf::Color::Red});
+  frame.append({toWindowCoords(L, -r2), sf::Color::Red});
+
+  sf::Font font;
+  if (!font.loadFromFile("arial.ttf")) {
+    std::cerr << "Failed to load font!" << std::endl;
+    return;
+  }
+  sf::Text hint("Press L for linear/log scale", font, 14);
+  hint.setFillColor(sf::Color(180, 180, 180));
+  hint.setPosition(700.f, 550.f);
+
+  bool displayed = false;
+  while (window.isOpen()) {
+    sf::Event event;
+    // the heatmap changes only on a key, so the loop sleeps until an event
+    bool pending = displayed && window.waitEvent(event);
+    while (pending || window.pollEvent(event)) {
+      pending = false;
+      if (event.type == sf::Event::Closed) window.close();
+      if (event.type == sf::Event::KeyPressed &&
+          event.key.code == sf::Keyboard::L) {
+        logScale = !logScale;
+        texture.update(occupancyImage(grid, logScale));
+      }
+    }
+
+    window.clear(sf::Color::Black);
+    window.draw(heatmap);
+    window.draw(frame);
+    window.draw(hint);
+    window.display();
+    displayed = true;
+  }
+}
+
+tb::MultipleResult runEnsembleDashboard(const tb::EnsembleConfig& config,
+                                        const tb::Border* borders) {
+  const float windowWidth = 1000.f;
+  const float windowHeight = 600.f;
+
+  tb::LiveEnsemble live{config, borders,
+                        std::max(1u, std::thread::hardware_concurrency())};
+
+  sf::Font font;
+  if (!font.loadFromFile("arial.ttf")) {
+    std::cerr << "Failed to load font!" << std::endl;
+    return live.result();
+  }
+
+  sf::RenderWindow window(
+      sf::VideoMode(static_cast<unsigned int>(windowWidth),
+                    static_cast<unsigned int>(windowHeight)),
+      "Triangular Billiards - Dashboard");
+  // a snapshot comes after each block, far less often than frames
+  window.setFramerateLimit(30);
+
+  // the histograms of final Y and Theta side by side, above the figures
+  struct Panel {
+    sf::FloatRect area;
+    sf::Color color;
+    sf::Text title{};
+    sf::Text low{};
+    sf::Text high{};
+  };
+  std::array<Panel, 2> panels{
+      Panel{{40.f, 50.f, 440.f, 300.f}, sf::Color(60, 120, 255)},
+      Panel{{520.f, 50.f, 440.f, 300.f}, sf::Color(255, 140, 0)}};
+  auto const initial = live.snapshot();
+  auto const format = [](double x) {
+    std::ostringstream os;
+    os << std::setprecision(4) << x;
+    return os.str();
+  };
+  for (std::size_t k = 0; k != panels.size(); ++k) {
+    auto& panel = panels[k];
+    auto const range = k == 0 ? initial.yRange : initial.thetaRange;
+    auto const bottom = panel.area.top + panel.area.height;
+    panel.title = {k == 0 ? "Final Y" : "Final Theta", font, 16};
+    panel.title.setPosition(panel.area.left, panel.area.top - 30.f);
+    panel.low = {format(-range), font, 12};
+    panel.low.setPosition(panel.area.left, bottom + 4.f);
+    panel.high = {format(range), font, 12};
+    panel.high.setPosition(panel.area.left + panel.area.width - 30.f,
+                           bottom + 4.f);
+    for (auto* text : {&panel.title, &panel.low, &panel.high}) {
+      text->setFillColor(sf::Color(180, 180, 180));
+    }
+  }
+  sf::VertexArray axes{sf::Lines};
+  for (auto const& panel : panels) {
+    auto const bottom = panel.area.top + panel.area.height;
+    axes.append({{panel.area.left, bottom}, sf::Color(90, 90, 90)});
+    axes.append({{panel.area.left + panel.area.width, bottom},
+                 sf::Color(90, 90, 90)});
+  }
+  sf::VertexArray bars{sf::Quads};
+
+  sf::Text figures{"", font, 14};
+  figures.setFillColor(sf::Color::White);
+  figures.setPosition(40.f, 390.f);
+  sf::Text hint{"Press Esc to cancel", font, 14};
+  hint.setFillColor(sf::Color(180, 180, 180));
+  hint.setPosition(750.f, 550.f);
+
+  sf::Clock clock;
+  float elapsed = 0.f;
+  bool done = false;
+  std::uint64_t shownGenerated = 0;
+  bool shown = false;
+
+  bool displayed = false;
+  while (window.isOpen()) {
+    sf::Event event;
+    // the run is over and the figures final, so the loop sleeps until an
+    // event instead of drawing them again
+    bool pending = displayed && done && window.waitEvent(event);
+    while (pending || window.pollEvent(event)) {
+      pending = false;
+      if (event.type == sf::Event::Closed) window.close();
+      if (event.type == sf::Event::KeyPressed &&
+          event.key.code == sf::Keyboard::Escape) {
+        live.cancel();
+      }
+    }
+
+    auto const snapshot = live.snapshot();
+    auto const generated = snapshot.accepted + snapshot.rejected;
+    if (!done) elapsed = clock.getElapsedTime().asSeconds();
+
+    // the figures change only when a block is merged, or the run ends
+    if (!shown || generated != shownGenerated || snapshot.done != done) {
+      done = snapshot.done;
+      shownGenerated = generated;
+      shown = true;
+
+      bars.clear();
+      for (std::size_t k = 0; k != panels.size(); ++k) {
+        auto const& panel = panels[k];
+        auto const* histogram =
+            k == 0 ? snapshot.histogramY : snapshot.histogramTheta;
+        auto const highest = std::max<std::uint64_t>(
+            1, *std::max_element(histogram, histogram + tb::snapshotBins));
+        auto const width =
+            panel.area.width / static_cast<float>(tb::snapshotBins);
+        auto const bottom = panel.area.top + panel.area.height;
+        for (std::size_t i = 0; i != tb::snapshotBins; ++i) {
+          if (histogram[i] == 0) continue;
+          auto const height = panel.area.height *
+                              static_cast<float>(histogram[i]) /
+                              static_cast<float>(highest);
+          auto const left = panel.area.left + static_cast<float>(i) * width;
+          bars.append({{left, bottom - height}, panel.color});
+          bars.append({{left + width, bottom - height}, panel.color});
+          bars.append({{left + width, bottom}, panel.color});
+          bars.append({{left, bottom}, panel.color});
+        }
+      }
+
+      std::ostringstream os;
+      os << "Accepted: " << snapshot.accepted
+         << "    Rejected: " << snapshot.rejected << "\nGenerated: "
+         << generated << " of " << snapshot.N << " ("
+         << std::setprecision(3)
+         << 100. * static_cast<double>(generated) /
+                static_cast<double>(snapshot.N)
+         << "%)\nThroughput: "
+         << (elapsed > 0.f ? static_cast<double>(generated) / elapsed : 0.)
+         << " particles/s\n";
+      for (auto [name, sums] : {std::pair{"Y", snapshot.finalY},
+                                std::pair{"Theta", snapshot.finalTheta}}) {
+        os << name << ": ";
+        if (sums.count < 4) {
+          os << "not enough particles\n";
+          continue;
+        }
+        auto const stats = tb::statistics(sums);
+        os << "mean " << format(stats.mean) << ", sigma "
+           << format(stats.sigma) << ", skewness " << format(stats.skewness)
+           << ", kurtosis " << format(stats.kurtosis) << '\n';
+      }
+      figures.setString(os.str());
+      if (done) {
+        hint.setString(live.cancelled() ? "Cancelled, close to return"
+                                        : "Done, close to return");
+      }
+    }
+
+    window.clear(sf::Color::Black);
+    window.draw(bars);
+    window.draw(axes);
+    for (auto const& panel : panels) {
+      window.draw(panel.title);
+      window.draw(panel.low);
+      window.draw(panel.high);
+    }
+    window.draw(figures);
+    window.draw(hint);
+    window.display();
+    displayed = true;
+  }
+
+  // closing the window before the end cancels the run
+  live.cancel();
+  return live.result();
+}
+
 }  // namespace tb
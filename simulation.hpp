@@ -2,9 +2,9 @@
 #define TB_VISUAL_HPP
 
 #include <SFML/Graphics.hpp>
+#include <array>
 #include <string>
-#include <iomanip>
-#include <sstream>
+#include <string_view>
 #include <iostream>
 #include "triangularbilliards.hpp"
 
@@ -14,9 +14,48 @@ sf::Vector2f normalize(const sf::Vector2f& v);
 float distance(const sf::Vector2f& a, const sf::Vector2f& b);
 std::string formatCoords(const tb::Particle& pos);
 
+/// @brief Buffer of formatCoords, reused from frame to frame; coordinates too
+/// long for it are left out.
+using CoordsBuffer = std::array<char, 96>;
+
+/// @brief Same text as above, formatted with std::to_chars into the buffer
+/// without allocating. The view is also null-terminated.
+std::string_view formatCoords(CoordsBuffer& buffer, const tb::Particle& pos);
+
 void runSimulation(const std::vector<tb::Particle>& collisions,
                    const tb::Border* borders);
 
+/// @brief Animates the trajectory of the particle while it is computed: a
+/// simulation thread generates the collisions ahead of the animation, at
+/// most a bounded number of them, so that the animation starts at once and
+/// the memory stays bounded even for trajectories with huge numbers of
+/// bounces.
+void runSimulation(const tb::Particle& start, const tb::Border* borders);
+
+/// @brief Shows all the trajectories of an ensemble at once, each coloured by
+/// its final angle, either overlaid or animated bounce by bounce. The
+/// segments are uploaded once to a vertex buffer and drawn with a single
+/// call per frame, so that tens of thousands of trajectories stay
+/// interactive.
+void runEnsembleSimulation(const std::vector<tb::Trajectory>& trajectories,
+                           const tb::Border* borders);
+
+/// @brief Image of the grid, one pixel per cell with the top row first,
+/// coloured by count relative to the largest one, on a logarithmic scale
+/// (of 1 + count) if requested.
+sf::Image occupancyImage(const tb::OccupancyGrid& grid, bool logScale);
+
+/// @brief Shows the occupancy grid of an ensemble as a heatmap over the
+/// billiard.
+void runOccupancyView(const tb::OccupancyGrid& grid, const tb::Border* borders);
+
+/// @brief Generates the ensemble on all the cores while a window shows its
+/// histograms of final Y and Theta, its counts, throughput and statistics,
+/// updated after every block. Esc, or closing the window, cancels the run,
+/// whose result then holds the blocks completed (see LiveEnsemble).
+tb::MultipleResult runEnsembleDashboard(const tb::EnsembleConfig& config,
+                                        const tb::Border* borders);
+
 }  // namespace tb
 
 #endif  // TB_VISUAL_HPP
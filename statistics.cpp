@@ -1,69 +1,295 @@
 #include "statistics.hpp"
 
+#include <sstream>
+#include <string>
+
 namespace tb {
-size_t Sample::size() const { return values_.size(); }
 
-void Sample::add(double x) { values_.push_back(x); }
+namespace {
 
-bool Sample::remove_all() {
-  values_.clear();
-  return true;
+template <class T>
+void writeRaw(std::ostream& os, const T& x) {
+  os.write(reinterpret_cast<const char*>(&x), sizeof(T));
 }
 
-Statistics Sample::statistics() const {
-  const size_t N = values_.size();
-  if (N < 4) throw std::runtime_error("Not enough points");
+template <class T>
+T readRaw(std::istream& is) {
+  T x{};
+  if (!is.read(reinterpret_cast<char*>(&x), sizeof(T))) {
+    throw std::runtime_error("Truncated sample state");
+  }
+  return x;
+}
 
-  struct Sums {
-    double x = 0.0;
-    double x2 = 0.0;
-  };
-  Sums sums = std::accumulate(values_.begin(), values_.end(), Sums{},
-                              [](Sums s, double x) {
-                                s.x += x;
-                                s.x2 += x * x;
-                                return s;
-                              });
-
-  auto NN = static_cast<double>(N);
-  double mean = sums.x / NN;
-
-  if ((sums.x2 - NN * mean * mean) <= 0) {
-    return {mean, 0.0, 0.0, 0.0};
+/// @brief Sample skewness and excess kurtosis from the sums of the third and
+/// fourth powers of the standardized values.
+Statistics shapeStatistics(double NN, double mean, double sigma, double z3_sum,
+                           double z4_sum) {
+  assert(NN >= 4);
+  double skewness = (NN / ((NN - 1.0) * (NN - 2.0))) * z3_sum;
+  double kurtosis =
+      (NN * (NN + 1.0)) / ((NN - 1.0) * (NN - 2.0) * (NN - 3.0)) * z4_sum -
+      (3.0 * (NN - 1.0) * (NN - 1.0)) / ((NN - 2.0) * (NN - 3.0));
+
+  return {mean, sigma, skewness, kurtosis};
+}
+
+}  // namespace
+
+void Moments::add(double x) {
+  auto const n1 = static_cast<double>(n_);
+  ++n_;
+  auto const n = static_cast<double>(n_);
+  auto const delta = x - mean_;
+  auto const delta_n = delta / n;
+  auto const delta_n2 = delta_n * delta_n;
+  auto const term1 = delta * delta_n * n1;
+
+  mean_ += delta_n;
+  m4_ += term1 * delta_n2 * (n * n - 3. * n + 3.) + 6. * delta_n2 * m2_ -
+         4. * delta_n * m3_;
+  m3_ += term1 * delta_n * (n - 2.) - 3. * delta_n * m2_;
+  m2_ += term1;
+}
+
+void Moments::merge(const Moments& other) {
+  if (other.n_ == 0) return;
+  if (n_ == 0) {
+    *this = other;
+    return;
+  }
+
+  auto const na = static_cast<double>(n_);
+  auto const nb = static_cast<double>(other.n_);
+  auto const n = na + nb;
+  auto const delta = other.mean_ - mean_;
+  auto const delta2 = delta * delta;
+
+  auto const m2 = m2_ + other.m2_ + delta2 * na * nb / n;
+  auto const m3 = m3_ + other.m3_ +
+                  delta2 * delta * na * nb * (na - nb) / (n * n) +
+                  3. * delta * (na * other.m2_ - nb * m2_) / n;
+  auto const m4 =
+      m4_ + other.m4_ +
+      delta2 * delta2 * na * nb * (na * na - na * nb + nb * nb) / (n * n * n) +
+      6. * delta2 * (na * na * other.m2_ + nb * nb * m2_) / (n * n) +
+      4. * delta * (na * other.m3_ - nb * m3_) / n;
+
+  n_ += other.n_;
+  mean_ += delta * nb / n;
+  m2_ = m2;
+  m3_ = m3;
+  m4_ = m4;
+}
+
+Statistics Moments::statistics() const {
+  if (n_ < 4) throw std::runtime_error("Not enough points");
+
+  auto NN = static_cast<double>(n_);
+  if (m2_ <= 0) {
+    return {mean_, 0.0, 0.0, 0.0};
   }
 
-  assert((sums.x2 - NN * mean * mean) / (NN - 1) > 0);
-  double sigma = std::sqrt((sums.x2 - NN * mean * mean) / (NN - 1));
+  double sigma = std::sqrt(m2_ / (NN - 1));
+  double sigma2 = sigma * sigma;
+  return shapeStatistics(NN, mean_, sigma, m3_ / (sigma2 * sigma),
+                         m4_ / (sigma2 * sigma2));
+}
+
+void Moments::save(std::ostream& os) const {
+  writeRaw(os, static_cast<std::uint64_t>(n_));
+  for (double m : {mean_, m2_, m3_, m4_}) writeRaw(os, m);
+}
+
+void Moments::load(std::istream& is) {
+  n_ = readRaw<std::uint64_t>(is);
+  mean_ = readRaw<double>(is);
+  m2_ = readRaw<double>(is);
+  m3_ = readRaw<double>(is);
+  m4_ = readRaw<double>(is);
+}
+
+Fixed16 Codec<Fixed16>::encode(double x) const {
+  assert(high > low);
+  auto const levels = static_cast<double>(UINT16_MAX);
+  auto const t = std::clamp((x - low) / (high - low), 0., 1.);
+  return {static_cast<std::uint16_t>(std::lround(t * levels))};
+}
+
+double Codec<Fixed16>::decode(Fixed16 v) const {
+  auto const levels = static_cast<double>(UINT16_MAX);
+  return static_cast<double>(v.code) / levels * (high - low) + low;
+}
 
-  /// @brief The Zahan summation algorithm is implemented to accurately
-  /// calculate skewness and kurtosis for samples of various sizes.
-  double z2_sum = 0.0, c2 = 0.0;
-  double z3_sum = 0.0, c3 = 0.0;
-  double z4_sum = 0.0, c4 = 0.0;
+template <class T>
+BasicSample<T>::BasicSample(std::size_t reservoirCapacity, std::uint64_t seed)
+  requires std::is_floating_point_v<T>
+    : BasicSample{Codec<T>{}, reservoirCapacity, seed} {}
 
-  auto kahan_add = [](double& sum, double& c, double v) {
-    auto y = v - c;
-    auto t = sum + y;
-    c = (t - sum) - y;
-    sum = t;
+template <class T>
+BasicSample<T>::BasicSample(Codec<T> codec, std::size_t reservoirCapacity,
+                            std::uint64_t seed)
+    : capacity_{reservoirCapacity}, engine_{seed}, codec_{codec} {
+  values_.reserve(capacity_);
+}
+
+template <class T>
+size_t BasicSample<T>::size() const {
+  return moments_.count();
+}
+
+template <class T>
+void BasicSample<T>::keep(T v, std::size_t n) {
+  if (capacity_ == 0 || values_.size() < capacity_) {
+    values_.push_back(v);
+    return;
+  }
+
+  // algorithm R: the n-th value replaces a random slot with probability k/n
+  std::uniform_int_distribution<std::size_t> slot{0, n - 1};
+  auto const j = slot(engine_);
+  if (j < capacity_) values_[j] = v;
+}
+
+template <class T>
+void BasicSample<T>::add(double x) {
+  moments_.add(x);
+  keep(codec_.encode(x), moments_.count());
+}
+
+template <class T>
+void BasicSample<T>::reserve(std::size_t n) {
+  values_.reserve(capacity_ == 0 ? n : std::min(n, capacity_));
+}
+
+template <class T>
+void BasicSample<T>::useMappedStorage(const std::string& directory) {
+  ValueBuffer<T> mapped{ByteStore{directory}};
+  mapped.reserve(values_.capacity());
+  mapped.append({values_.data(), values_.size()});
+  values_ = std::move(mapped);
+}
+
+template <class T>
+void BasicSample<T>::merge(const BasicSample& other) {
+  if (!(codec_ == other.codec_)) {
+    throw std::invalid_argument("Cannot merge samples with different ranges");
+  }
+  if (capacity_ == 0) {
+    values_.append({other.values_.data(), other.values_.size()});
+    moments_.merge(other.moments_);
+    return;
+  }
+  if (other.values_.size() == other.moments_.count()) {
+    // every value of the other sample is known, so they can simply go
+    // through algorithm R, in a time independent of the capacity
+    auto n = moments_.count();
+    for (auto v : other.values_) keep(v, ++n);
+    moments_.merge(other.moments_);
+    return;
+  }
+  if (other.values_.size() < std::min(capacity_, other.moments_.count())) {
+    throw std::invalid_argument("Cannot merge a smaller reservoir");
+  }
+
+  // each slot is drawn from either side with probability proportional to the
+  // number of values that side still represents; within a side, the retained
+  // values are a uniform subset, so picking among them at random is unbiased
+  std::vector<T> left(values_.begin(), values_.end());
+  std::vector<T> right(other.values_.begin(), other.values_.end());
+  auto leftSeen = moments_.count();
+  auto rightSeen = other.moments_.count();
+
+  moments_.merge(other.moments_);
+  auto const k = std::min(capacity_, moments_.count());
+  values_.clear();
+
+  auto pick = [this](std::vector<T>& pool) {
+    assert(!pool.empty());
+    std::uniform_int_distribution<std::size_t> slot{0, pool.size() - 1};
+    auto const j = slot(engine_);
+    auto const x = pool[j];
+    pool[j] = pool.back();
+    pool.pop_back();
+    return x;
   };
 
-  assert(sigma != 0.);
-  for (double x : values_) {
-    double z = (x - mean) / sigma;
-    double z2 = z * z;
-    kahan_add(z2_sum, c2, z2);
-    kahan_add(z3_sum, c3, z2 * z);
-    kahan_add(z4_sum, c4, z2 * z2);
+  while (values_.size() < k) {
+    std::uniform_int_distribution<std::size_t> side{1, leftSeen + rightSeen};
+    if (side(engine_) <= leftSeen) {
+      values_.push_back(pick(left));
+      --leftSeen;
+    } else {
+      values_.push_back(pick(right));
+      --rightSeen;
+    }
   }
+}
 
-  assert(NN >= 4);
-  double skewness = (NN / ((NN - 1.0) * (NN - 2.0))) * z3_sum;
-  double kurtosis =
-      (NN * (NN + 1.0)) / ((NN - 1.0) * (NN - 2.0) * (NN - 3.0)) * z4_sum -
-      (3.0 * (NN - 1.0) * (NN - 1.0)) / ((NN - 2.0) * (NN - 3.0));
+template <class T>
+bool BasicSample<T>::remove_all() {
+  values_.clear();
+  moments_.reset();
+  return true;
+}
 
-  return {mean, sigma, skewness, kurtosis};
+template <class T>
+void BasicSample<T>::save(std::ostream& os) const {
+  moments_.save(os);
+  writeRaw(os, static_cast<std::uint64_t>(capacity_));
+  writeRaw(os, codec_);
+
+  std::ostringstream engine;
+  engine << engine_;
+  auto const state = engine.str();
+  writeRaw(os, static_cast<std::uint64_t>(state.size()));
+  os.write(state.data(), static_cast<std::streamsize>(state.size()));
+
+  writeRaw(os, static_cast<std::uint64_t>(values_.size()));
+  os.write(reinterpret_cast<const char*>(values_.data()),
+           static_cast<std::streamsize>(values_.size() * sizeof(T)));
 }
 
-}  // namespace tb
\ No newline at end of file
+template <class T>
+void BasicSample<T>::load(std::istream& is) {
+  moments_.load(is);
+  capacity_ = readRaw<std::uint64_t>(is);
+  codec_ = readRaw<Codec<T>>(is);
+
+  auto const length = readRaw<std::uint64_t>(is);
+  if (length > (1 << 16)) throw std::runtime_error("Invalid sample state");
+  std::string state(length, '\0');
+  is.read(state.data(), static_cast<std::streamsize>(state.size()));
+  std::istringstream engine{state};
+  if (!is || !(engine >> engine_)) {
+    throw std::runtime_error("Invalid sample state");
+  }
+
+  // read in blocks, so that a mapped sample never needs the values in memory
+  auto const n = readRaw<std::uint64_t>(is);
+  values_.clear();
+  values_.reserve(n);
+  std::vector<T> block(std::min<std::uint64_t>(n, 1 << 16));
+  for (std::uint64_t done = 0; done < n; done += block.size()) {
+    block.resize(std::min<std::uint64_t>(n - done, block.size()));
+    if (!is.read(reinterpret_cast<char*>(block.data()),
+                 static_cast<std::streamsize>(block.size() * sizeof(T)))) {
+      throw std::runtime_error("Truncated sample state");
+    }
+    values_.append(block);
+  }
+}
+
+/// @brief Always from the streaming moments, whether every value is retained,
+/// a subset or none (e.g. after merging compact shards), so that equal moments
+/// give bitwise equal statistics.
+template <class T>
+Statistics BasicSample<T>::statistics() const {
+  return moments_.statistics();
+}
+
+template class BasicSample<double>;
+template class BasicSample<float>;
+template class BasicSample<Fixed16>;
+
+}  // namespace tb
@@ -4,10 +4,17 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <istream>
 #include <numeric>
+#include <ostream>
+#include <random>
 #include <stdexcept>
+#include <type_traits>
 #include <vector>
 
+#include "buffer.hpp"
+
 namespace tb {
 
 /// @brief Summary statistics of a numerical sample.
@@ -19,27 +26,168 @@ struct Statistics {
   double kurtosis;
 };
 
-/// @brief Represents numerical sample and provides stats
-class Sample {
-  std::vector<double> values_{};
+/// @brief Streaming central moments up to the fourth order.
+/// Values are accumulated one at a time with the one-pass update formulas of
+/// Welford and Pébay, so no raw value needs to be kept. Two accumulators can be
+/// merged, e.g. when each thread fills its own.
+class Moments {
+  std::size_t n_{0};
+  double mean_{0.};
+  double m2_{0.};
+  double m3_{0.};
+  double m4_{0.};
+
+ public:
+  Moments() = default;
+
+  /// @brief An accumulator with the state of another, e.g. as published.
+  Moments(std::size_t n, double mean, double m2, double m3, double m4)
+      : n_{n}, mean_{mean}, m2_{m2}, m3_{m3}, m4_{m4} {}
+
+  std::size_t count() const { return n_; }
+  double mean() const { return mean_; }
+
+  /// @brief Sums of the 2nd, 3rd and 4th powers of the deviations from the
+  /// mean.
+  double m2() const { return m2_; }
+  double m3() const { return m3_; }
+  double m4() const { return m4_; }
+
+  void add(double x);
+
+  void merge(const Moments& other);
+
+  void reset() { *this = Moments{}; }
+
+  Statistics statistics() const;
+
+  /// @brief Writes the exact state of the accumulator in binary form.
+  void save(std::ostream& os) const;
+  void load(std::istream& is);
+};
+
+/// @brief 16-bit fixed-point code of a value known to lie in a range, e.g. a
+/// final Y in [-r2, r2].
+struct Fixed16 {
+  std::uint16_t code;
+};
+
+/// @brief Conversion between the stored representation and double. Floating
+/// point types are stored as they are (float rounds to ~7 digits).
+template <class T>
+struct Codec {
+  T encode(double x) const { return static_cast<T>(x); }
+  double decode(T v) const { return static_cast<double>(v); }
+  bool operator==(const Codec&) const = default;
+};
+
+/// @brief Values in [low, high] are mapped onto 65536 evenly spaced levels;
+/// values outside the range are clamped. Each column has a codec of its own,
+/// hence its own range.
+template <>
+struct Codec<Fixed16> {
+  double low;
+  double high;
+
+  Fixed16 encode(double x) const;
+  double decode(Fixed16 v) const;
+  bool operator==(const Codec&) const = default;
+};
+
+/// @brief Represents numerical sample and provides stats.
+/// By default every value is retained. A sample built with a non-zero
+/// reservoir capacity keeps instead a uniform random subset of at most that
+/// many values (Vitter's algorithm R), while the moments are still computed
+/// over all the values added. Two reservoirs built with the same seed and fed
+/// in lock-step make the same choices, so paired columns (e.g. Y and Theta)
+/// stay aligned.
+/// Values are stored as T (double, float or Fixed16), but the moments are
+/// always accumulated in double precision from the values as they are added.
+/// The values are kept in memory, or in a memory-mapped file for samples
+/// larger than the RAM.
+/// Runs (EnsembleConfig, scripts, shards and the C API) always store doubles:
+/// FloatSample and Fixed16Sample are building blocks for users of the
+/// library, which fill them from the results of a run.
+template <class T>
+class BasicSample {
+  ValueBuffer<T> values_{};
+  Moments moments_{};
+  std::size_t capacity_{0};
+  std::mt19937_64 engine_{};
+  Codec<T> codec_{};
+
+  /// @brief Algorithm R step for a value that is the n-th one seen.
+  void keep(T v, std::size_t n);
 
  public:
+  BasicSample()
+    requires std::is_floating_point_v<T>
+  = default;
+
+  explicit BasicSample(std::size_t reservoirCapacity, std::uint64_t seed)
+    requires std::is_floating_point_v<T>;
+
+  explicit BasicSample(Codec<T> codec, std::size_t reservoirCapacity = 0,
+                       std::uint64_t seed = 0);
+
+  /// @brief Retained values, as stored: all of them, or the reservoir content.
   const auto& values() const { return values_; }
 
-  auto& values() { return values_; }
+  /// @brief The i-th retained value, decoded.
+  double value(std::size_t i) const { return codec_.decode(values_[i]); }
+
+  const Codec<T>& codec() const { return codec_; }
 
+  /// @brief Number of values added, retained or not.
   size_t size() const;
 
+  bool isReservoir() const { return capacity_ != 0; }
+  std::size_t capacity() const { return capacity_; }
+
+  const Moments& moments() const { return moments_; }
+
   void add(double x);
 
+  /// @brief Reserves room for n values (at most the reservoir capacity).
+  void reserve(std::size_t n);
+
+  /// @brief Moves the values to a memory-mapped file created in the
+  /// directory, which then grows in chunks as values are added.
+  void useMappedStorage(const std::string& directory);
+  bool isMapped() const { return values_.isMapped(); }
+
+  /// @brief Adds the content of another sample, as if its values had been
+  /// added to this one. Reservoirs are merged into a uniform subset of the
+  /// union.
+  void merge(const BasicSample& other);
+
+  /// @brief Adds values known only by their moments, e.g. a block of a run
+  /// stored without its values: none of them is retained.
+  void mergeMoments(const Moments& other) { moments_.merge(other); }
+
   bool remove_all();
 
+  /// @brief Writes the exact state of the sample (moments, reservoir engine
+  /// and retained values) in binary form, so that a sample restored by load()
+  /// continues as the original would have. The storage backend is not saved:
+  /// load() keeps the one of the sample it is called on.
+  void save(std::ostream& os) const;
+  void load(std::istream& is);
+
   using value_type = double;
   void push_back(double x) { add(x); }
 
   Statistics statistics() const;
 };
 
+using Sample = BasicSample<double>;
+using FloatSample = BasicSample<float>;
+using Fixed16Sample = BasicSample<Fixed16>;
+
+extern template class BasicSample<double>;
+extern template class BasicSample<float>;
+extern template class BasicSample<Fixed16>;
+
 }  // namespace tb
 
-#endif
\ No newline at end of file
+#endif
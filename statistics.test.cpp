@@ -1,6 +1,8 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "statistics.hpp"
 
+#include <filesystem>
+
 #include "doctest.h"
 
 TEST_CASE("Testing the class handling a floating point data sample") {
@@ -163,4 +165,226 @@ TEST_CASE("Testing the class handling a floating point data sample") {
     CHECK(sample.size() == 0);
     CHECK_THROWS(sample.statistics());
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Testing the streaming moments") {
+  tb::Moments moments;
+  tb::Sample sample;
+  for (double x : {0.2, -0.5, 0.9, -0.1, 1.0, -0.75, 0.64, 0.24, -0.37, 0.00,
+                   0.10, -0.16}) {
+    moments.add(x);
+    sample.add(x);
+  }
+  CHECK(moments.count() == 12);
+
+  SUBCASE("Same statistics as the stored sample") {
+    auto expected = sample.statistics();
+    auto result = moments.statistics();
+    CHECK(result.mean == doctest::Approx(expected.mean));
+    CHECK(result.sigma == doctest::Approx(expected.sigma));
+    CHECK(result.skewness == doctest::Approx(expected.skewness));
+    CHECK(result.kurtosis == doctest::Approx(expected.kurtosis));
+  }
+
+  SUBCASE("Merging two halves") {
+    tb::Moments left;
+    tb::Moments right;
+    auto const& values = sample.values();
+    for (size_t i = 0; i != values.size(); ++i) {
+      (i < 5 ? left : right).add(values[i]);
+    }
+    left.merge(right);
+    CHECK(left.count() == 12);
+    auto result = left.statistics();
+    CHECK(result.mean == doctest::Approx(0.1000));
+    CHECK(result.sigma == doctest::Approx(0.5387));
+    CHECK(result.skewness == doctest::Approx(0.3082).epsilon(.01));
+    CHECK(result.kurtosis == doctest::Approx(-0.5571).epsilon(.0001));
+  }
+
+  SUBCASE("Not enough points throws") {
+    tb::Moments few;
+    few.add(1.);
+    few.add(2.);
+    CHECK_THROWS(few.statistics());
+  }
+}
+
+TEST_CASE("Testing the reservoir sample") {
+  tb::Sample reservoir{100, 42};
+  tb::Sample all;
+  for (int i = 0; i != 10000; ++i) {
+    auto x = std::sin(i * 0.37) + 0.001 * i;
+    reservoir.add(x);
+    all.add(x);
+  }
+
+  SUBCASE("Memory is bounded, count and statistics cover every value") {
+    CHECK(reservoir.isReservoir());
+    CHECK(reservoir.size() == 10000);
+    CHECK(reservoir.values().size() == 100);
+    auto expected = all.statistics();
+    auto result = reservoir.statistics();
+    CHECK(result.mean == doctest::Approx(expected.mean));
+    CHECK(result.sigma == doctest::Approx(expected.sigma));
+    CHECK(result.skewness == doctest::Approx(expected.skewness));
+    CHECK(result.kurtosis == doctest::Approx(expected.kurtosis));
+  }
+
+  SUBCASE("Same seed keeps paired columns aligned") {
+    tb::Sample first{10, 7};
+    tb::Sample second{10, 7};
+    for (int i = 0; i != 1000; ++i) {
+      first.add(i);
+      second.add(-i);
+    }
+    for (size_t i = 0; i != 10; ++i) {
+      CHECK(first.values()[i] == -second.values()[i]);
+    }
+  }
+
+  SUBCASE("Retained values are spread over the whole stream") {
+    tb::Sample indices{1000, 3};
+    for (int i = 0; i != 100000; ++i) indices.add(i);
+    auto mean = std::accumulate(indices.values().begin(),
+                                indices.values().end(), 0.) /
+                1000.;
+    CHECK(mean == doctest::Approx(50000.).epsilon(0.05));
+  }
+
+  SUBCASE("Merging reservoirs") {
+    tb::Sample other{100, 43};
+    for (int i = 0; i != 5000; ++i) other.add(3.);
+    reservoir.merge(other);
+    CHECK(reservoir.size() == 15000);
+    CHECK(reservoir.values().size() == 100);
+    auto threes = std::count(reservoir.values().begin(),
+                             reservoir.values().end(), 3.);
+    CHECK(threes > 10);
+    CHECK(threes < 60);
+  }
+
+  SUBCASE("Merging a smaller reservoir throws") {
+    tb::Sample small{10, 43};
+    for (int i = 0; i != 5000; ++i) small.add(3.);
+    CHECK_THROWS(reservoir.merge(small));
+  }
+
+  SUBCASE("Removing all points") {
+    reservoir.remove_all();
+    CHECK(reservoir.size() == 0);
+    CHECK(reservoir.values().empty());
+  }
+}
+
+TEST_CASE("Testing the compressed sample storage") {
+  tb::Sample exact;
+  tb::FloatSample single;
+  tb::Fixed16Sample fixed{tb::Codec<tb::Fixed16>{-20., 20.}};
+  for (int i = 0; i != 1000; ++i) {
+    auto x = 15. * std::sin(i * 0.37) + 0.001 * i;
+    exact.add(x);
+    single.add(x);
+    fixed.add(x);
+  }
+  auto expected = exact.statistics();
+
+  SUBCASE("Float values keep about seven digits") {
+    CHECK(sizeof(single.values()[0]) == 4);
+    for (size_t i = 0; i != 1000; ++i) {
+      CHECK(single.value(i) == doctest::Approx(exact.value(i)).epsilon(1e-6));
+    }
+  }
+
+  SUBCASE("Fixed-point values are within half a level") {
+    CHECK(sizeof(fixed.values()[0]) == 2);
+    auto const step = 40. / 65535.;
+    for (size_t i = 0; i != 1000; ++i) {
+      CHECK(std::abs(fixed.value(i) - exact.value(i)) <= step / 2.);
+    }
+  }
+
+  SUBCASE("Fixed-point range ends and clamping") {
+    tb::Codec<tb::Fixed16> codec{-20., 20.};
+    CHECK(codec.encode(-20.).code == 0);
+    CHECK(codec.encode(20.).code == 65535);
+    CHECK(codec.encode(100.).code == 65535);
+    CHECK(codec.decode(codec.encode(0.)) == doctest::Approx(0.).epsilon(1e-3));
+  }
+
+  SUBCASE("Fixed-point columns with ranges of their own") {
+    tb::Codec<tb::Fixed16> codec{0., 1.5};
+    CHECK(codec.encode(0.).code == 0);
+    CHECK(codec.encode(-1.).code == 0);
+    CHECK(codec.encode(1.5).code == 65535);
+    CHECK(codec.decode(codec.encode(0.75)) ==
+          doctest::Approx(0.75).epsilon(1e-4));
+    tb::Fixed16Sample theta{codec};
+    theta.add(1.2);
+    CHECK(std::abs(theta.value(0) - 1.2) <= 1.5 / 65535. / 2.);
+  }
+
+  SUBCASE("Statistics are computed in double precision") {
+    for (auto result : {single.statistics(), fixed.statistics()}) {
+      CHECK(result.mean == doctest::Approx(expected.mean));
+      CHECK(result.sigma == doctest::Approx(expected.sigma));
+      CHECK(result.skewness == doctest::Approx(expected.skewness));
+      CHECK(result.kurtosis == doctest::Approx(expected.kurtosis));
+    }
+  }
+
+  SUBCASE("Merging samples with different ranges throws") {
+    tb::Fixed16Sample other{tb::Codec<tb::Fixed16>{-10., 10.}};
+    CHECK_THROWS(fixed.merge(other));
+  }
+}
+
+TEST_CASE("Testing reserve") {
+  // a reservoir never holds more than its capacity
+  tb::Sample reservoir{4, 1};
+  reservoir.reserve(1000);
+  for (int i = 0; i != 16; ++i) reservoir.add(0.1 * i);
+  CHECK(reservoir.size() == 16);
+  CHECK(reservoir.values().size() == 4);
+  CHECK(reservoir.values().capacity() == 4);
+}
+
+TEST_CASE("Testing the memory-mapped sample storage") {
+  auto const directory = std::filesystem::temp_directory_path().string();
+  tb::Sample memory;
+  tb::Sample mapped;
+  mapped.add(0.5);
+  mapped.useMappedStorage(directory);
+  memory.add(0.5);
+  CHECK(mapped.isMapped());
+  CHECK(!memory.isMapped());
+
+  // enough values to grow the file past its first chunk
+  for (int i = 0; i != 10000000; ++i) {
+    auto x = std::sin(i * 0.37) + 1e-7 * i;
+    memory.add(x);
+    mapped.add(x);
+  }
+
+  CHECK(mapped.size() == memory.size());
+  CHECK(mapped.values() == memory.values());
+  auto expected = memory.statistics();
+  auto result = mapped.statistics();
+  CHECK(result.mean == expected.mean);
+  CHECK(result.sigma == expected.sigma);
+  CHECK(result.skewness == expected.skewness);
+  CHECK(result.kurtosis == expected.kurtosis);
+
+  SUBCASE("A copy is mapped too") {
+    tb::Sample copy = mapped;
+    CHECK(copy.isMapped());
+    CHECK(copy.values() == mapped.values());
+  }
+
+  SUBCASE("Removing all points") {
+    mapped.remove_all();
+    CHECK(mapped.values().empty());
+    mapped.add(1.);
+    CHECK(mapped.values()[0] == 1.);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef TBILL_H
+#define TBILL_H
+
+/* C interface to the triangular billiard engine, for use from C and from
+ * other languages through a shared library. Functions returning int return
+ * TB_OK on success, TB_ERR_ARGUMENT when an argument is invalid (a null
+ * pointer, a size out of range) and TB_ERROR on any other failure, with a
+ * description available from tb_last_error(). Buffers are owned by the
+ * caller and are read or written in place. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define TB_API __declspec(dllexport)
+#else
+#define TB_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TB_API_VERSION 2
+
+enum { TB_OK = 0, TB_ERROR = -1, TB_ERR_ARGUMENT = -2 };
+
+typedef struct tb_border tb_border;
+typedef struct tb_ensemble tb_ensemble;
+
+typedef struct {
+  double mean;
+  double sigma;
+  double skewness;
+  double kurtosis;
+} tb_statistics;
+
+/* N particles with Y0 and Theta0 drawn from normal distributions; with a
+ * non-zero reservoir only a uniform subset of that many particles is
+ * retained, the statistics still covering all of them. struct_size must be
+ * set to sizeof(tb_ensemble_config), so that the library can tell which
+ * version of the structure it is given: later versions only add fields at
+ * the end, which take their default value when a caller built against an
+ * older header leaves them out. A struct_size smaller than the first version
+ * or larger than the library knows is an invalid argument, as are a
+ * non-positive n and negative spreads. */
+typedef struct {
+  size_t struct_size;
+  int32_t n;
+  double y0_mean;
+  double y0_err;
+  double theta0_mean;
+  double theta0_err;
+  uint64_t seed;
+  uint64_t reservoir;
+} tb_ensemble_config;
+
+/* Version of the interface the library was built with. */
+TB_API int tb_api_version(void);
+
+/* Message of the last error of the calling thread. */
+TB_API const char* tb_last_error(void);
+
+/* Negative radii and a non-positive length are invalid arguments. */
+TB_API int tb_border_create(double r1, double r2, double l, tb_border** out);
+TB_API void tb_border_destroy(tb_border* border);
+
+/* Final (Y, Theta) of count initial (Y0, Theta0), both as consecutive pairs
+ * of doubles, using the given number of threads (0 for all of them). The
+ * final state of a particle that cannot be simulated is NaN. A count whose
+ * pairs do not fit in size_t is an invalid argument. */
+TB_API int tb_final_states(const tb_border* border, const double* initial,
+                           double* final, size_t count, unsigned threads);
+
+TB_API int tb_ensemble_run(const tb_border* border,
+                           const tb_ensemble_config* config,
+                           tb_ensemble** out);
+TB_API void tb_ensemble_destroy(tb_ensemble* ensemble);
+
+TB_API int tb_ensemble_counts(const tb_ensemble* ensemble, int64_t* accepted,
+                              int64_t* rejected);
+
+/* Retained final values, valid until the ensemble is destroyed. */
+TB_API size_t tb_ensemble_size(const tb_ensemble* ensemble);
+TB_API const double* tb_ensemble_final_y(const tb_ensemble* ensemble);
+TB_API const double* tb_ensemble_final_theta(const tb_ensemble* ensemble);
+
+TB_API int tb_ensemble_statistics(const tb_ensemble* ensemble,
+                                  tb_statistics* final_y,
+                                  tb_statistics* final_theta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
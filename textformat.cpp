@@ -0,0 +1,65 @@
+#include "textformat.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <vector>
+
+namespace tb {
+
+void formatRows(std::string& buffer,
+                std::span<const std::span<const double>> columns,
+                std::size_t first, std::size_t last, TextFormat format,
+                std::size_t stride) {
+  // a double takes at most 24 characters in shortest form, plus the
+  // requested digits otherwise
+  auto const width =
+      static_cast<std::size_t>(24 + std::max(format.precision, 0) + 1);
+  auto const lineWidth = width * columns.size();
+
+  auto used = buffer.size();
+  buffer.resize(used + (last - first) * lineWidth);
+  auto out = buffer.data() + used;
+  auto const end = buffer.data() + buffer.size();
+
+  for (auto i = first; i != last; ++i) {
+    for (std::size_t c = 0; c != columns.size(); ++c) {
+      if (c != 0) *out++ = format.separator;
+      auto const x = columns[c][i * stride];
+      auto const r =
+          format.precision < 0
+              ? std::to_chars(out, end, x)
+              : std::to_chars(out, end, x, std::chars_format::general,
+                              format.precision);
+      assert(r.ec == std::errc{});
+      out = r.ptr;
+    }
+    *out++ = '\n';
+  }
+  buffer.resize(static_cast<std::size_t>(out - buffer.data()));
+}
+
+void writeRows(std::ostream& out,
+               std::span<const std::span<const double>> columns,
+               std::size_t rows, TextFormat format, ThreadPool& pool,
+               std::size_t stride) {
+  constexpr std::size_t blockRows = 1 << 12;
+  std::vector<std::string> buffers(pool.size() * 4);
+  for (std::size_t first = 0; first < rows;
+       first += blockRows * buffers.size()) {
+    for (std::size_t b = 0; b != buffers.size(); ++b) {
+      pool.submit([&, first, b] {
+        auto const begin = std::min(rows, first + b * blockRows);
+        auto const end = std::min(rows, begin + blockRows);
+        buffers[b].clear();
+        formatRows(buffers[b], columns, begin, end, format, stride);
+      });
+    }
+    pool.wait();
+    for (auto const& buffer : buffers) {
+      out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+  }
+}
+
+}  // namespace tb
@@ -0,0 +1,45 @@
+#ifndef TEXTFORMAT_HPP
+#define TEXTFORMAT_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <span>
+#include <string>
+
+#include "threadpool.hpp"
+
+namespace tb {
+
+/// @brief Layout of a text export: one particle per line, the columns
+/// separated by `separator`. A negative precision gives the shortest
+/// representation that reads back to the same double.
+struct TextFormat {
+  char separator = ' ';
+  int precision = -1;
+  bool header = false;
+};
+
+inline constexpr TextFormat csvFormat{',', -1, true};
+inline constexpr TextFormat tsvFormat{'\t', -1, true};
+
+/// @brief Appends rows [first, last) of the columns to the buffer as text,
+/// the numbers being formatted with std::to_chars. Row i is made of the
+/// values at i * stride of each column, so that columns interleaved in one
+/// array (e.g. pairs of final states) are formatted in place.
+void formatRows(std::string& buffer,
+                std::span<const std::span<const double>> columns,
+                std::size_t first, std::size_t last, TextFormat format,
+                std::size_t stride = 1);
+
+/// @brief Writes rows [0, rows) of the columns to the stream, as formatRows
+/// does. Rounds of consecutive blocks of rows are formatted in parallel by
+/// the tasks of the pool, then written in order, the buffers being reused
+/// from one round to the next.
+void writeRows(std::ostream& out,
+               std::span<const std::span<const double>> columns,
+               std::size_t rows, TextFormat format, ThreadPool& pool,
+               std::size_t stride = 1);
+
+}  // namespace tb
+
+#endif
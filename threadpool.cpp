@@ -0,0 +1,61 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace tb {
+
+ThreadPool::ThreadPool(unsigned threads) {
+  threads = std::max(threads, 1u);
+  workers_.reserve(threads);
+  for (unsigned i = 0; i != threads; ++i) {
+    workers_.emplace_back(&ThreadPool::work, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock{mutex_};
+    stopping_ = true;
+  }
+  ready_.notify_all();
+  for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::work() {
+  std::unique_lock lock{mutex_};
+  while (true) {
+    ready_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+    if (tasks_.empty()) return;
+
+    auto task = std::move(tasks_.front());
+    tasks_.pop_front();
+    ++running_;
+    lock.unlock();
+    try {
+      task();
+    } catch (...) {
+      lock.lock();
+      if (!error_) error_ = std::current_exception();
+      lock.unlock();
+    }
+    lock.lock();
+    if (--running_ == 0 && tasks_.empty()) idle_.notify_all();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard lock{mutex_};
+    tasks_.push_back(std::move(task));
+  }
+  ready_.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock{mutex_};
+  idle_.wait(lock, [this] { return running_ == 0 && tasks_.empty(); });
+  if (error_) std::rethrow_exception(std::exchange(error_, nullptr));
+}
+
+}  // namespace tb
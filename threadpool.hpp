@@ -0,0 +1,50 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tb {
+
+/// @brief Fixed set of worker threads running the submitted tasks in the
+/// order they were submitted. An exception thrown by a task is kept and
+/// rethrown by wait(); the other tasks still run.
+class ThreadPool {
+  std::vector<std::thread> workers_{};
+  std::deque<std::function<void()>> tasks_{};
+  std::size_t running_{0};
+  bool stopping_{false};
+  std::exception_ptr error_{};
+  std::mutex mutex_{};
+  std::condition_variable ready_{};
+  std::condition_variable idle_{};
+
+  void work();
+
+ public:
+  /// @brief A pool of the given number of threads (at least one).
+  explicit ThreadPool(unsigned threads);
+
+  /// @brief Waits for the tasks already submitted, then stops the threads.
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  void submit(std::function<void()> task);
+
+  /// @brief Waits until every task submitted so far has completed.
+  void wait();
+
+  std::size_t size() const { return workers_.size(); }
+};
+
+}  // namespace tb
+
+#endif
@@ -1,6 +1,11 @@
 #include "triangularbilliards.hpp"
 
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <random>
+#include <stdexcept>
 
 namespace tb {
 void reduceAngle(double& p) {
@@ -96,26 +101,12 @@ size_t Trajectory::size() const { return positions_.size(); }
 
 void Trajectory::simulateCollisions(const Border* border) {
   assert(!positions_.empty());
-  auto const sigma = std::atan2(border->r2() - border->r1(), border->xEnd());
-  // size_t i = 0;
-  while (positions_.back().x < border->xEnd() && border->checkCollision(positions_.back()) != BorderHit::None) {
-    auto p = positions_.back();
-
-    computeNextCollision(p, border, sigma);
-    assert(p.x >= positions_.back().x);
-
-    positions_.push_back(p);
-  }
-
-  if (positions_.back().x > border->xEnd()) {
-    positions_.pop_back();
-  }
-
-  auto p = positions_.back();
-  computeFinalPosition(p, border);
-  assert(p.y <= border->r2() || p.y >= -border->r2());
-
-  positions_.push_back(p);
+  CollisionGenerator generator{positions_.back(), border};
+  // the start is already stored
+  generator.next();
+  while (auto p = generator.next()) positions_.push_back(*p);
+  assert(positions_.back().y <= border->r2() ||
+         positions_.back().y >= -border->r2());
 }
 
 const Particle& Trajectory::getFinalPosition() const {
@@ -140,63 +131,363 @@ Trajectory computeSingleTrajectory(Particle& p, const Border* border) {
   return traj;
 }
 
+CollisionGenerator::CollisionGenerator(Particle p, const Border* border)
+    : border_{border},
+      sigma_{std::atan2(border->r2() - border->r1(), border->xEnd())},
+      current_{p} {
+  reduceAngle(current_.theta);
+  if (std::abs(current_.theta) == M_PI / 2 && border->r1() == border->r2()) {
+    throw std::runtime_error("Invalid conditions");
+  }
+  assert(current_.y <= border->r1() && current_.y >= -border->r1());
+}
+
+/// @brief The single implementation of the steps of a trajectory, shared by
+/// every computation of one: a collision past the end is dropped in favour of
+/// the final position.
+std::optional<Particle> CollisionGenerator::next() {
+  if (done_) return std::nullopt;
+  if (!started_) {
+    started_ = true;
+    return current_;
+  }
+
+  if (current_.x < border_->xEnd() &&
+      border_->checkCollision(current_) != BorderHit::None) {
+    auto p = current_;
+    computeNextCollision(p, border_, sigma_);
+    assert(p.x >= current_.x);
+    if (p.x <= border_->xEnd()) {
+      current_ = p;
+      return current_;
+    }
+  }
+
+  done_ = true;
+  auto final = current_;
+  computeFinalPosition(final, border_);
+  return final;
+}
+
+/// @brief Steps of a CollisionGenerator, keeping only the last position
+/// instead of the whole trajectory.
+SingleResult computeFinalState(Particle p, const Border* border) {
+  assert(border->r1() >= 0 && border->r2() >= 0 && border->xEnd() >= 0);
+  CollisionGenerator generator{p, border};
+  while (auto next = generator.next()) p = *next;
+  return {p.x, p.y, p.theta, true};
+}
+
 SingleResult simulateFinalState(Particle& p, const Border* border) {
-  auto final = computeSingleTrajectory(p, border).getFinalPosition();
-  return {final.x, final.y, final.theta, true};
+  reduceAngle(p.theta);
+  return computeFinalState(p, border);
 }
 
-MultipleResult runMultipleSimulations(int N, double Y0_mean, double& Y0_err,
-                                      double Theta0_mean, double& Theta0_err,
+/// @brief Expected number of initial positions Y0 ~ N(mean, err) falling
+/// within [-r1, r1], rounded up.
+std::size_t expectedAccepted(int N, double Y0_mean, double Y0_err, double r1) {
+  assert(N > 0 && Y0_err >= 0);
+  if (Y0_err == 0) {
+    return std::abs(Y0_mean) <= r1 ? static_cast<std::size_t>(N) : 0;
+  }
+  auto const s = Y0_err * std::sqrt(2.);
+  auto const p =
+      0.5 * (std::erf((r1 - Y0_mean) / s) - std::erf((-r1 - Y0_mean) / s));
+  return static_cast<std::size_t>(std::ceil(p * N));
+}
+
+namespace {
+
+/// @brief Identifies the run a checkpoint belongs to; a checkpoint is only
+/// resumed by a run with the same parameters.
+struct CheckpointHeader {
+  char magic[8];
+  std::uint64_t version;
+  std::uint64_t N;
+  double Y0_mean;
+  double Y0_err;
+  double Theta0_mean;
+  double Theta0_err;
+  std::uint64_t seed;
+  std::uint64_t reservoir;
+  std::uint64_t keepInitial;
+  std::uint64_t block;
+  double r1;
+  double r2;
+  double l;
+  std::uint32_t occupancyWidth;
+  std::uint32_t occupancyHeight;
+};
+static_assert(sizeof(CheckpointHeader) == 120, "No padding expected");
+
+CheckpointHeader makeCheckpointHeader(const EnsembleConfig& config,
                                       const Border* border) {
+  return {{'T', 'B', 'C', 'H', 'E', 'C', 'K', '\0'},
+          3,
+          static_cast<std::uint64_t>(config.N),
+          config.Y0_mean,
+          std::abs(config.Y0_err),
+          config.Theta0_mean,
+          std::abs(config.Theta0_err),
+          config.seed,
+          config.reservoir,
+          config.keepInitial,
+          ensembleBlock,
+          border->r1(),
+          border->r2(),
+          border->xEnd(),
+          config.occupancyWidth,
+          config.occupancyHeight};
+}
+
+/// @brief Samples of the result that are filled by the run.
+std::vector<Sample*> runSamples(const EnsembleConfig& config,
+                                MultipleResult& result) {
+  std::vector<Sample*> samples{&result.finalY, &result.finalTheta};
+  if (config.keepInitial) {
+    samples.push_back(&result.initialY);
+    samples.push_back(&result.initialTheta);
+  }
+  return samples;
+}
+
+/// @brief Written to a temporary file first and then renamed, so that an
+/// interruption while saving leaves the previous checkpoint intact.
+void saveCheckpoint(const EnsembleConfig& config, const Border* border,
+                    std::uint64_t nextBlock, MultipleResult& result) {
+  auto const tmp = config.checkpoint + ".tmp";
+  {
+    std::ofstream os{tmp, std::ios::binary | std::ios::trunc};
+    auto const header = makeCheckpointHeader(config, border);
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (std::uint64_t x :
+         {nextBlock, static_cast<std::uint64_t>(result.accepted),
+          static_cast<std::uint64_t>(result.rejected)}) {
+      os.write(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+    for (auto sample : runSamples(config, result)) sample->save(os);
+    if (!result.occupancy.empty()) result.occupancy.save(os);
+    os.close();
+    if (!os) {
+      throw std::runtime_error("Impossible to write " + tmp);
+    }
+  }
+  std::filesystem::rename(tmp, config.checkpoint);
+}
+
+/// @brief Restores the result saved in the checkpoint and returns the first
+/// block still to be generated.
+std::uint64_t loadCheckpoint(const EnsembleConfig& config,
+                             const Border* border, MultipleResult& result) {
+  std::ifstream is{config.checkpoint, std::ios::binary};
+  CheckpointHeader header{};
+  std::uint64_t counts[3]{};
+  is.read(reinterpret_cast<char*>(&header), sizeof(header));
+  is.read(reinterpret_cast<char*>(counts), sizeof(counts));
+  if (!is) {
+    throw std::runtime_error("Invalid checkpoint " + config.checkpoint);
+  }
+  auto const expected = makeCheckpointHeader(config, border);
+  if (std::memcmp(&header, &expected, sizeof(header)) != 0) {
+    throw std::runtime_error("Checkpoint " + config.checkpoint +
+                             " belongs to a different run");
+  }
+
+  for (auto sample : runSamples(config, result)) sample->load(is);
+  if (!result.occupancy.empty()) result.occupancy.load(is);
+  result.accepted = static_cast<int>(counts[1]);
+  result.rejected = static_cast<int>(counts[2]);
+  return counts[0];
+}
+
+}  // namespace
+
+std::uint64_t ensembleBlocks(int N) {
   assert(N > 0);
+  return static_cast<std::uint64_t>((N - 1) / ensembleBlock + 1);
+}
 
-  if (Y0_err < 0) {
-    Y0_err = - Y0_err;
+MultipleResult makeEnsembleResult(const EnsembleConfig& config,
+                                  const Border* border) {
+  // same seed for all reservoirs, so that they keep the same particles
+  auto const reservoirSeed = std::mt19937_64{config.seed}();
+  auto const reservoir = config.reservoir;
+  MultipleResult result{tb::Sample{reservoir, reservoirSeed},
+                        tb::Sample{reservoir, reservoirSeed}, 0, 0};
+  if (config.keepInitial) {
+    result.initialY = tb::Sample{reservoir, reservoirSeed};
+    result.initialTheta = tb::Sample{reservoir, reservoirSeed};
   }
-  assert(Y0_err >= 0);
 
-  if (Theta0_err < 0) {
-    Theta0_err = -Theta0_err;
+  if (!config.mapDirectory.empty()) {
+    for (auto sample : runSamples(config, result)) {
+      sample->useMappedStorage(config.mapDirectory);
+    }
   }
-  assert(Theta0_err >= 0);
 
-  tb::Sample finalPosY;
-  tb::Sample finalPosTheta;
+  auto const expected = expectedAccepted(config.N, config.Y0_mean,
+                                         std::abs(config.Y0_err), border->r1());
+  for (auto sample : runSamples(config, result)) sample->reserve(expected);
 
-  std::random_device r;
-  std::default_random_engine eng{r()};
-  std::normal_distribution<double> dist_y{Y0_mean, Y0_err};
-  std::normal_distribution<double> dist_theta{Theta0_mean, Theta0_err};
+  if (config.occupancyWidth != 0) {
+    result.occupancy = OccupancyGrid{config.occupancyWidth,
+                                     config.occupancyHeight, *border};
+  }
+  return result;
+}
 
-  auto accepted = 0;
-  auto rejected = 0;
+MultipleResult runEnsembleBlock(const EnsembleConfig& config,
+                                const Border* border, std::uint64_t block) {
+  assert(block < ensembleBlocks(config.N));
+  std::seed_seq seq{config.seed & 0xffffffff, config.seed >> 32,
+                    block & 0xffffffff, block >> 32};
+  std::mt19937_64 eng{seq};
+  std::normal_distribution<double> dist_y{config.Y0_mean,
+                                          std::abs(config.Y0_err)};
+  std::normal_distribution<double> dist_theta{config.Theta0_mean,
+                                              std::abs(config.Theta0_err)};
+
+  // first + ensembleBlock, capped at N without overflowing
+  auto const first = static_cast<int>(block) * ensembleBlock;
+  auto const last = std::min(config.N - ensembleBlock, first) + ensembleBlock;
+
+  auto const reservoirSeed = eng();
+  auto const reservoir = config.reservoir;
+  MultipleResult result{tb::Sample{reservoir, reservoirSeed},
+                        tb::Sample{reservoir, reservoirSeed}, 0, 0};
+  if (config.keepInitial) {
+    result.initialY = tb::Sample{reservoir, reservoirSeed};
+    result.initialTheta = tb::Sample{reservoir, reservoirSeed};
+  }
+  for (auto sample : runSamples(config, result)) {
+    sample->reserve(static_cast<std::size_t>(last - first));
+  }
+  // each block fills a grid of its own, whatever thread or process runs it
+  if (config.occupancyWidth != 0) {
+    result.occupancy = OccupancyGrid{config.occupancyWidth,
+                                     config.occupancyHeight, *border};
+  }
 
-  for (auto i = 0; i != N; ++i) {
+  // positions of the current trajectory, when it fills the grid
+  std::vector<Particle> path;
+  for (auto i = first; i != last; ++i) {
     tb::Particle pos{0., dist_y(eng), dist_theta(eng)};
+    tb::Particle const initial = pos;
 
     if (pos.y > border->r1() || pos.y < -border->r1()) {
-      ++rejected;
+      ++result.rejected;
       continue;
     }
 
     SingleResult final;
     try {
-      final = simulateFinalState(pos, border);
+      if (result.occupancy.empty()) {
+        final = simulateFinalState(pos, border);
+      } else {
+        // a single pass gives both the final state and the segments of the
+        // grid, added once the particle is accepted
+        path.clear();
+        CollisionGenerator generator{pos, border};
+        while (auto next = generator.next()) path.push_back(*next);
+        final = {path.back().x, path.back().y, path.back().theta, true};
+      }
     } catch (const std::exception& e) {
       final = {0., 0., 0., false};
     }
 
     if (!final.valid) {
-      ++rejected;
+      ++result.rejected;
       continue;
     }
 
-    finalPosY.push_back(final.y);
-    finalPosTheta.push_back(final.theta);
-    ++accepted;
+    result.finalY.push_back(final.y);
+    result.finalTheta.push_back(final.theta);
+    if (config.keepInitial) {
+      result.initialY.push_back(initial.y);
+      result.initialTheta.push_back(initial.theta);
+    }
+    if (config.sink != nullptr) {
+      config.sink->accept(initial.y, initial.theta, final.y, final.theta);
+    }
+    for (std::size_t k = 1; k < path.size(); ++k) {
+      result.occupancy.addSegment(path[k - 1], path[k]);
+    }
+    ++result.accepted;
   }
 
-  return {finalPosY, finalPosTheta, accepted, rejected};
+  return result;
+}
+
+void mergeEnsembleBlock(MultipleResult& result, const MultipleResult& block) {
+  result.finalY.merge(block.finalY);
+  result.finalTheta.merge(block.finalTheta);
+  result.initialY.merge(block.initialY);
+  result.initialTheta.merge(block.initialTheta);
+  result.occupancy.merge(block.occupancy);
+  result.accepted += block.accepted;
+  result.rejected += block.rejected;
+}
+
+MultipleResult runMultipleSimulations(const EnsembleConfig& config,
+                                      const Border* border) {
+  assert(config.N > 0);
+
+  // the result is filled in place and returned by NRVO, so the samples are
+  // never copied
+  auto result = makeEnsembleResult(config, border);
+
+  std::uint64_t block = 0;
+  auto const checkpointed = !config.checkpoint.empty();
+  // a checkpoint rewrites the retained values every time, which is only
+  // bounded with a reservoir; all the values are streamed by a sink instead
+  if (checkpointed && config.reservoir == 0) {
+    throw std::invalid_argument(
+        "Checkpoints need a reservoir, stream all the values instead");
+  }
+  if (checkpointed && std::filesystem::exists(config.checkpoint)) {
+    block = loadCheckpoint(config, border, result);
+    if (config.sink != nullptr) {
+      config.sink->resume(static_cast<std::uint64_t>(result.accepted));
+    }
+  }
+
+  auto const blocks = ensembleBlocks(config.N);
+  auto lastCheckpoint = std::chrono::steady_clock::now();
+  for (; block != blocks; ++block) {
+    mergeEnsembleBlock(result, runEnsembleBlock(config, border, block));
+    if (config.sink != nullptr) config.sink->progress(result);
+
+    auto const now = std::chrono::steady_clock::now();
+    if (checkpointed && block + 1 != blocks &&
+        std::chrono::duration<double>(now - lastCheckpoint).count() >=
+            config.checkpointInterval) {
+      if (config.sink != nullptr) config.sink->flush();
+      saveCheckpoint(config, border, block + 1, result);
+      lastCheckpoint = now;
+    }
+  }
+
+  if (checkpointed) std::filesystem::remove(config.checkpoint);
+  return result;
+}
+
+MultipleResult runMultipleSimulations(int N, double Y0_mean, double& Y0_err,
+                                      double Theta0_mean, double& Theta0_err,
+                                      const Border* border,
+                                      std::size_t reservoir) {
+  if (Y0_err < 0) {
+    Y0_err = - Y0_err;
+  }
+  assert(Y0_err >= 0);
+
+  if (Theta0_err < 0) {
+    Theta0_err = -Theta0_err;
+  }
+  assert(Theta0_err >= 0);
+
+  std::random_device r;
+  return runMultipleSimulations(
+      {N, Y0_mean, Y0_err, Theta0_mean, Theta0_err, r(), reservoir}, border);
 }
 
 }  // namespace tb
\ No newline at end of file
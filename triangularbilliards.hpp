@@ -1,8 +1,14 @@
 #ifndef TRIANGULAR_BILLIARDS_HPP
 #define TRIANGULAR_BILLIARDS_HPP
 
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "occupancy.hpp"
 #include "statistics.hpp"
 
 namespace tb {
@@ -38,6 +44,10 @@ struct StraightBorder : Border {
 };
 
 struct OpenedBorder : Border {
+ private:
+  double sigma_;
+
+ public:
   explicit OpenedBorder(double r1, double r2, double l);
   BorderHit checkCollision(const Particle& p) const override;
 };
@@ -61,6 +71,82 @@ struct MultipleResult {
   Sample finalTheta;
   int accepted;
   int rejected;
+  Sample initialY{};
+  Sample initialTheta{};
+  OccupancyGrid occupancy{};
+};
+
+/// @brief Receives every accepted particle of a run as soon as it is
+/// generated, e.g. to stream it to disk.
+struct ParticleSink {
+  virtual ~ParticleSink() = default;
+  virtual void accept(double Y0, double Theta0, double Yf, double Thetaf) = 0;
+
+  /// @brief Makes the particles received so far durable; called before each
+  /// checkpoint of the run.
+  virtual void flush() {}
+
+  /// @brief Called when a run resumes from a checkpoint, before any particle,
+  /// with the number of particles accepted up to that checkpoint.
+  virtual void resume(std::uint64_t /*accepted*/) {}
+
+  /// @brief Called after each block of particles with the result so far.
+  virtual void progress(const MultipleResult& /*result*/) {}
+};
+
+/// @brief Forwards everything it receives to several sinks, in order.
+class SinkTee : public ParticleSink {
+  std::vector<ParticleSink*> sinks_;
+
+ public:
+  explicit SinkTee(std::vector<ParticleSink*> sinks)
+      : sinks_{std::move(sinks)} {}
+
+  void accept(double Y0, double Theta0, double Yf, double Thetaf) override {
+    for (auto sink : sinks_) sink->accept(Y0, Theta0, Yf, Thetaf);
+  }
+  void flush() override {
+    for (auto sink : sinks_) sink->flush();
+  }
+  void resume(std::uint64_t accepted) override {
+    for (auto sink : sinks_) sink->resume(accepted);
+  }
+  void progress(const MultipleResult& result) override {
+    for (auto sink : sinks_) sink->progress(result);
+  }
+};
+
+/// @brief Number of particles generated from each pseudo-random sequence.
+/// Every block has its own sequence, derived from the seed of the run, so
+/// that a run can be checkpointed and resumed at any block boundary.
+inline constexpr int ensembleBlock = 1 << 16;
+
+/// @brief Parameters of a Monte Carlo run: N particles with Y0 and Theta0
+/// drawn from normal distributions, using a pseudo-random sequence fully
+/// determined by the seed.
+/// With a checkpoint file, the state of the run is saved there at most every
+/// checkpointInterval seconds, and a run started while the file exists
+/// resumes from it, with the same final result as an uninterrupted run. The
+/// file is removed when the run completes. Checkpoints need a reservoir, so
+/// that their size does not grow with the run; the values of a run that keeps
+/// them all are made durable by streaming them to a sink.
+/// With a non-zero occupancy size, the trajectories of the accepted particles
+/// are also rasterized into an occupancy grid of that many cells.
+struct EnsembleConfig {
+  int N;
+  double Y0_mean;
+  double Y0_err;
+  double Theta0_mean;
+  double Theta0_err;
+  std::uint64_t seed;
+  std::size_t reservoir = 0;
+  bool keepInitial = false;
+  ParticleSink* sink = nullptr;
+  std::string mapDirectory{};
+  std::string checkpoint{};
+  double checkpointInterval = 60.;
+  unsigned occupancyWidth = 0;
+  unsigned occupancyHeight = 0;
 };
 
 void reduceAngle(double& p);
@@ -87,15 +173,70 @@ class Trajectory {
 
 Trajectory computeSingleTrajectory(Particle& p, const Border* b);
 
+/// @brief The positions of a trajectory computed one at a time, on demand:
+/// the start, every collision and the final position, the same as those of
+/// computeSingleTrajectory, but without storing them. Throws on invalid
+/// initial conditions, as computeSingleTrajectory does.
+class CollisionGenerator {
+  const Border* border_;
+  double sigma_;
+  Particle current_;
+  bool started_{false};
+  bool done_{false};
+
+ public:
+  explicit CollisionGenerator(Particle p, const Border* b);
+
+  /// @brief The next position, or nothing after the final one.
+  std::optional<Particle> next();
+};
+
+/// @brief Final state of the particle, computed without storing its
+/// trajectory, so that no memory is allocated. Same result as the final
+/// position of computeSingleTrajectory.
+SingleResult computeFinalState(Particle p, const Border* b);
+
 SingleResult simulateFinalState(Particle& p, const Border* b);
 
-SingleResult simulateFinalState(Particle& p, const Border& b) {
+inline SingleResult simulateFinalState(Particle& p, const Border& b) {
   return simulateFinalState(p, &b);
 }
 
+std::size_t expectedAccepted(int N, double Y0_mean, double Y0_err, double r1);
+
+/// @brief Number of blocks of ensembleBlock particles of a run of N.
+std::uint64_t ensembleBlocks(int N);
+
+/// @brief Empty result of a run, to which its blocks are merged.
+MultipleResult makeEnsembleResult(const EnsembleConfig& config,
+                                  const Border* b);
+
+/// @brief Generates the particles of one block of the run into a result of
+/// their own. Blocks depend only on the configuration and their index, so
+/// they can be generated in any order, or by different processes.
+MultipleResult runEnsembleBlock(const EnsembleConfig& config, const Border* b,
+                                std::uint64_t block);
+
+/// @brief Adds the particles of a block to the result of the run. A run is
+/// the merge of its blocks in order, so merging the same blocks in the same
+/// order always gives the same result, to the last bit. The values of the
+/// block are copied once, into the room makeEnsembleResult reserved for the
+/// whole run: taking over the buffer of the block would give that up.
+void mergeEnsembleBlock(MultipleResult& result, const MultipleResult& block);
+
+/// @brief Generates the particles described by the configuration and collects
+/// their final Y and Theta (and, if requested, the accepted Y0 and Theta0).
+/// With a non-zero reservoir only a uniform subset of that many particles is
+/// retained, while the statistics still cover every accepted particle. With a
+/// map directory, the samples are stored in memory-mapped files created there.
+MultipleResult runMultipleSimulations(const EnsembleConfig& config,
+                                      const Border* b);
+
+/// @brief As above, with a random seed.
 MultipleResult runMultipleSimulations(int N, double Y0_mean, double& Y0_err,
                                       double Theta0_mean, double& Theta0_err,
-                                      const Border* b);
+                                      const Border* b,
+                                      std::size_t reservoir = 0);
 
 }  // namespace tb
 
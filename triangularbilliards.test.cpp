@@ -1,5 +1,9 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+
 #include "doctest.h"
 #include "triangularbilliards.hpp"
 
@@ -487,6 +491,40 @@ TEST_CASE("Testing trajectory class") {
   }
 }
 
+TEST_CASE("Testing CollisionGenerator class") {
+  std::mt19937_64 eng{3};
+  std::uniform_real_distribution<double> y{-10., 10.};
+  std::uniform_real_distribution<double> theta{-1.5, 1.5};
+
+  for (double r2 : {10., 15., 2.}) {
+    auto const border = tb::createBorder(10., r2, 40.);
+    for (int i = 0; i != 300; ++i) {
+      tb::Particle p{0., y(eng), theta(eng)};
+      std::vector<tb::Particle> generated;
+      try {
+        tb::CollisionGenerator generator{p, border.get()};
+        while (auto next = generator.next()) generated.push_back(*next);
+      } catch (const std::runtime_error&) {
+        CHECK_THROWS(tb::computeSingleTrajectory(p, border.get()));
+        continue;
+      }
+      auto const positions =
+          tb::computeSingleTrajectory(p, border.get()).positions();
+      REQUIRE(generated.size() == positions.size());
+      for (std::size_t k = 0; k != positions.size(); ++k) {
+        CHECK(generated[k].x == positions[k].x);
+        CHECK(generated[k].y == positions[k].y);
+        CHECK(generated[k].theta == positions[k].theta);
+      }
+    }
+  }
+
+  SUBCASE("Invalid initial conditions") {
+    tb::StraightBorder border{20., 20., 50.};
+    CHECK_THROWS(tb::CollisionGenerator{{0., 0., M_PI / 2}, &border});
+  }
+}
+
 TEST_CASE("Testing runMultipleSimulations() function") {
   SUBCASE("Testing N - valid initial conditions to simulate trajectory") {
     std::unique_ptr<tb::Border> border =
@@ -527,4 +565,80 @@ TEST_CASE("Testing runMultipleSimulations() function") {
     CHECK(result.accepted + result.rejected == N);
     CHECK(result.rejected >= 0);
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Testing expectedAccepted() function") {
+  CHECK(tb::expectedAccepted(1000, 0., 0., 20.) == 1000);
+  CHECK(tb::expectedAccepted(1000, 25., 0., 20.) == 0);
+  CHECK(tb::expectedAccepted(10000, 0., 1., 1.) == 6827);
+  CHECK(tb::expectedAccepted(10000, 20., 1., 20.) == 5000);
+}
+
+TEST_CASE("Testing checkpoints of a run keeping all values") {
+  auto const path =
+      (std::filesystem::temp_directory_path() / "tb_checkpoint.all").string();
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{tb::ensembleBlock, 5., 1., 0.785, 0.01, 42};
+  config.checkpoint = path;
+  CHECK_THROWS_AS(tb::runMultipleSimulations(config, &border),
+                  std::invalid_argument);
+  CHECK(!std::filesystem::exists(path));
+}
+
+TEST_CASE("Testing checkpoint and resume") {
+  auto const path =
+      (std::filesystem::temp_directory_path() / "tb_checkpoint.test").string();
+  std::filesystem::remove(path);
+  tb::StraightBorder border{20., 15., 50.};
+  tb::EnsembleConfig config{3 * tb::ensembleBlock + 100, 5., 1., 0.785, 0.01,
+                            42, 1000, true};
+  SUBCASE("Keeping a reservoir") {}
+  SUBCASE("Keeping a reservoir larger than the run") {
+    config.reservoir = std::size_t{1} << 20;
+  }
+  SUBCASE("Filling an occupancy grid") {
+    config.occupancyWidth = 64;
+    config.occupancyHeight = 32;
+  }
+
+  // stops the run as a preemption would, halfway through the third block
+  struct Interrupt : tb::ParticleSink {
+    int left = 2 * tb::ensembleBlock + tb::ensembleBlock / 2;
+    void accept(double, double, double, double) override {
+      if (--left == 0) throw std::runtime_error("Interrupted");
+    }
+  } interrupt;
+
+  auto const uninterrupted = tb::runMultipleSimulations(config, &border);
+
+  config.checkpoint = path;
+  config.checkpointInterval = 0.;
+  config.sink = &interrupt;
+  CHECK_THROWS(tb::runMultipleSimulations(config, &border));
+  REQUIRE(std::filesystem::exists(path));
+
+  SUBCASE("A different run does not resume from the checkpoint") {
+    config.sink = nullptr;
+    config.seed = 43;
+    CHECK_THROWS(tb::runMultipleSimulations(config, &border));
+    config.seed = 42;
+  }
+
+  config.sink = nullptr;
+  auto const resumed = tb::runMultipleSimulations(config, &border);
+  CHECK(!std::filesystem::exists(path));
+
+  CHECK(resumed.accepted == uninterrupted.accepted);
+  CHECK(resumed.rejected == uninterrupted.rejected);
+  CHECK(resumed.finalY.values() == uninterrupted.finalY.values());
+  CHECK(resumed.finalTheta.values() == uninterrupted.finalTheta.values());
+  CHECK(resumed.initialY.values() == uninterrupted.initialY.values());
+  CHECK(resumed.initialTheta.values() == uninterrupted.initialTheta.values());
+  CHECK(resumed.occupancy.counts() == uninterrupted.occupancy.counts());
+  auto const a = resumed.finalTheta.statistics();
+  auto const b = uninterrupted.finalTheta.statistics();
+  CHECK(a.mean == b.mean);
+  CHECK(a.sigma == b.sigma);
+  CHECK(a.skewness == b.skewness);
+  CHECK(a.kurtosis == b.kurtosis);
+}